@@ -0,0 +1,197 @@
+/**
+******************************************************************************
+* @file    bench_channel.cpp
+* @brief   MessageChannel ping-pong latency and throughput
+*
+* Usage: bench_channel [round trips] [messages per producer] [producers]
+*                      [capacity]
+*
+* Ping-pong: two servers on two threads bounce one message back and forth
+* through a channel each way; reports the one way latency percentiles.
+* Throughput: 1 then N producer threads post to a consumer server as fast
+* as they can, retrying when the channel is full; reports the messages
+* per second and how often the producers found the channel full.
+*****************************************************************************/
+
+#include <sched.h>
+#include <pthread.h>
+#include "bench_util.hpp"
+#include "message_channel.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+/*************************************************************************//**
+** Messages are send times: each end posts back what it receives
+*/
+class PingChannel : public MessageChannel<uint64_t>
+{
+public:
+	PingChannel(SocketServer * const server, unsigned const capacity):
+		MessageChannel<uint64_t>(server, capacity),
+		peer(0),
+		remaining(0)
+	{}
+
+	void on_message(uint64_t & sent) {
+		uint64_t const now = bench_now_ns();
+		latencies.push_back(now - sent);
+		if (remaining == 0) {
+			get_server()->stop();
+			peer->get_server()->stop();
+			return;
+		}
+		remaining--;
+		peer->post(bench_now_ns());
+	}
+
+	PingChannel * peer;
+	size_t remaining;
+	vector<uint64_t> latencies;
+};
+
+
+/*************************************************************************//**
+** Counts the messages, stops its server after the last one
+*/
+class CountChannel : public MessageChannel<uint64_t>
+{
+public:
+	CountChannel(SocketServer * const server, unsigned const capacity):
+		MessageChannel<uint64_t>(server, capacity),
+		received(0),
+		expected(0)
+	{}
+
+	void on_message(uint64_t &) {
+		if (++received == expected)
+			get_server()->stop();
+	}
+
+	uint64_t received;
+	uint64_t expected;
+};
+
+
+struct producer_ctx {
+	CountChannel * channel;
+	uint64_t messages;
+	uint64_t full;
+};
+
+
+/*************************************************************************//**
+**
+*/
+static void * run_server(void * const arg)
+{
+	static_cast<SocketServer *>(arg)->run();
+	return 0;
+}
+
+
+static void * producer_thread(void * const arg)
+{
+	producer_ctx * const ctx = static_cast<producer_ctx *>(arg);
+	for (uint64_t i = 0; i < ctx->messages; i++) {
+		while (ctx->channel->post(i) != 0) {
+			ctx->full++;
+			sched_yield();
+		}
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+** The servers are created here, their channels before they run
+*/
+static int ping_pong(size_t const round_trips, unsigned const capacity)
+{
+	SocketServer a;
+	SocketServer b;
+	PingChannel to_a(&a, capacity);
+	PingChannel to_b(&b, capacity);
+	if (!to_a.is_ready() || !to_b.is_ready())
+		return -1;
+	to_a.peer = &to_b;
+	to_b.peer = &to_a;
+	to_a.remaining = round_trips;
+	to_b.remaining = round_trips;
+
+	pthread_t thread;
+	if (pthread_create(&thread, 0, run_server, &b) != 0)
+		return -1;
+	to_b.post(bench_now_ns());
+	a.run();
+	pthread_join(thread, 0);
+
+	vector<uint64_t> latencies(to_a.latencies);
+	latencies.insert(latencies.end(), to_b.latencies.begin(), to_b.latencies.end());
+	uint64_t const p50 = bench_percentile(latencies, 50);
+	uint64_t const p99 = bench_percentile(latencies, 99);
+	printf("ping-pong  %zu messages, one way: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+		   latencies.size(), p50 / 1e3, p99 / 1e3, latencies.back() / 1e3);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static int throughput(unsigned const producers, uint64_t const messages, unsigned const capacity)
+{
+	SocketServer server;
+	CountChannel channel(&server, capacity);
+	if (!channel.is_ready())
+		return -1;
+	channel.expected = messages * producers;
+
+	pthread_t consumer;
+	if (pthread_create(&consumer, 0, run_server, &server) != 0)
+		return -1;
+	vector<producer_ctx> ctx(producers);
+	vector<pthread_t> threads(producers);
+	uint64_t const start = bench_now_ns();
+	for (unsigned i = 0; i < producers; i++) {
+		ctx[i].channel = &channel;
+		ctx[i].messages = messages;
+		ctx[i].full = 0;
+		pthread_create(&threads[i], 0, producer_thread, &ctx[i]);
+	}
+	uint64_t full = 0;
+	for (unsigned i = 0; i < producers; i++) {
+		pthread_join(threads[i], 0);
+		full += ctx[i].full;
+	}
+	pthread_join(consumer, 0);
+	uint64_t const elapsed = bench_now_ns() - start;
+
+	printf("throughput %2u producers: %12.0f msg/s, channel full %llu times\n", producers,
+		   channel.received * 1e9 / elapsed, (unsigned long long)full);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	size_t const round_trips = bench_arg(argc, argv, 1, 100000);
+	uint64_t const messages = bench_arg(argc, argv, 2, 2000000);
+	unsigned const producers = bench_arg(argc, argv, 3, 4);
+	unsigned const capacity = bench_arg(argc, argv, 4, MessageChannel<uint64_t>::DEFAULT_CAPACITY);
+	if ((round_trips == 0) || (messages == 0) || (producers == 0) || (capacity == 0)) {
+		fprintf(stderr, "usage: %s [round trips] [messages per producer] [producers] [capacity]\n", argv[0]);
+		return 1;
+	}
+
+	printf("channel capacity %u\n", capacity);
+	int res = ping_pong(round_trips, capacity);
+	res |= throughput(1, messages, capacity);
+	if (producers > 1)
+		res |= throughput(producers, messages, capacity);
+	return (res == 0) ? 0 : 1;
+}
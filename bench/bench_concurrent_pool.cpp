@@ -0,0 +1,180 @@
+/**
+******************************************************************************
+* @file    bench_concurrent_pool.cpp
+* @brief   ConcurrentPoolAllocator against malloc and new, 1 / 4 / 16 threads
+*
+* Usage: bench_concurrent_pool [operations per thread] [object size 64|256]
+*
+* Each thread allocates a batch of objects and frees them, over and over;
+* then threads are paired, and each frees the batches its partner
+* allocated (cross thread release). Reports ns per allocation + release.
+*****************************************************************************/
+
+#include <sched.h>
+#include <pthread.h>
+#include "bench_util.hpp"
+#include "concurrent_pool_allocator.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+static const unsigned BATCH = 64;
+static const unsigned MAX_THREADS = 16;
+
+enum alloc_mode {
+	MODE_POOL,
+	MODE_MALLOC,
+	MODE_NEW
+};
+
+template <size_t N>
+struct object {
+	uint8_t data[N];
+};
+
+
+/*************************************************************************//**
+**
+*/
+template <class T>
+class Bench
+{
+public:
+	Bench(alloc_mode const mode, unsigned const threads, unsigned long const ops):
+		mode(mode),
+		threads(threads),
+		rounds(ops / BATCH),
+		pool(mode == MODE_POOL ? new ConcurrentPoolAllocator<T>(256) : 0)
+	{
+		memset(handoff, 0, sizeof(handoff));
+		memset(ready, 0, sizeof(ready));
+	}
+
+	~Bench() {
+		delete pool;
+	}
+
+	/**
+	 * @return ns per allocation and release
+	 */
+	double run() {
+		vector<pthread_t> tids(threads);
+		vector<thread_arg> args(threads);
+		uint64_t const start = bench_now_ns();
+		for (unsigned i = 0; i < threads; i++) {
+			args[i].bench = this;
+			args[i].index = i;
+			pthread_create(&tids[i], 0, thread_main, &args[i]);
+		}
+		for (unsigned i = 0; i < threads; i++)
+			pthread_join(tids[i], 0);
+		uint64_t const elapsed = bench_now_ns() - start;
+		return (double)elapsed / ((double)threads * (rounds + rounds / 4) * BATCH);
+	}
+
+private:
+	struct thread_arg {
+		Bench * bench;
+		unsigned index;
+	};
+
+	T * alloc() {
+		switch (mode) {
+			case MODE_POOL: return pool->alloc_object();
+			case MODE_MALLOC: return static_cast<T *>(malloc(sizeof(T)));
+			default: return new T;
+		}
+	}
+
+	void release(T * const p) {
+		switch (mode) {
+			case MODE_POOL: pool->free_object(p); break;
+			case MODE_MALLOC: free(p); break;
+			default: delete p; break;
+		}
+	}
+
+	static void * thread_main(void * const arg) {
+		thread_arg const * const a = static_cast<thread_arg *>(arg);
+		a->bench->work(a->index);
+		return 0;
+	}
+
+	void work(unsigned const id) {
+		T * batch[BATCH];
+		for (unsigned long r = 0; r < rounds; r++) {
+			for (unsigned i = 0; i < BATCH; i++) {
+				batch[i] = alloc();
+				batch[i]->data[0] = 1;
+			}
+			for (unsigned i = 0; i < BATCH; i++)
+				release(batch[i]);
+		}
+
+		// Cross thread: free what the partner allocated
+		unsigned const partner = ((id ^ 1) < threads) ? (id ^ 1) : id;
+		for (unsigned long r = 0; r < rounds / 4; r++) {
+			for (unsigned i = 0; i < BATCH; i++)
+				handoff[id][i] = alloc();
+			__atomic_store_n(&ready[id], 1, __ATOMIC_RELEASE);
+			while (!__atomic_load_n(&ready[partner], __ATOMIC_ACQUIRE))
+				sched_yield();
+			for (unsigned i = 0; i < BATCH; i++)
+				release(handoff[partner][i]);
+			__atomic_store_n(&ready[partner], 0, __ATOMIC_RELEASE);
+			while (__atomic_load_n(&ready[id], __ATOMIC_ACQUIRE))
+				sched_yield();
+		}
+	}
+
+private:
+	alloc_mode mode;
+	unsigned threads;
+	unsigned long rounds;
+	ConcurrentPoolAllocator<T> * pool;
+	T * handoff[MAX_THREADS][BATCH];
+	int ready[MAX_THREADS];
+};
+
+
+/*************************************************************************//**
+**
+*/
+template <class T>
+static void run_all(unsigned long const ops)
+{
+	static const unsigned thread_counts[] = { 1, 4, MAX_THREADS };
+	static const char * const names[] = { "pool", "malloc", "new" };
+
+	printf("%zu byte objects, %lu operations per thread\n", sizeof(T), ops);
+	printf("%8s %10s %10s %10s\n", "threads", names[0], names[1], names[2]);
+	for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+		printf("%8u", thread_counts[t]);
+		for (int mode = MODE_POOL; mode <= MODE_NEW; mode++) {
+			Bench<T> * const bench = new Bench<T>((alloc_mode)mode, thread_counts[t], ops);
+			printf(" %7.1f ns", bench->run());
+			delete bench;
+		}
+		printf("\n");
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	unsigned long const ops = bench_arg(argc, argv, 1, 200000);
+	unsigned long const size = bench_arg(argc, argv, 2, 64);
+	if ((ops < 4 * BATCH) || ((size != 64) && (size != 256))) {
+		fprintf(stderr, "usage: %s [operations per thread >= %u] [object size 64|256]\n", argv[0], 4 * BATCH);
+		return 1;
+	}
+	if (size == 64)
+		run_all< object<64> >(ops);
+	else
+		run_all< object<256> >(ops);
+	return 0;
+}
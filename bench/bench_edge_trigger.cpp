@@ -0,0 +1,300 @@
+/**
+******************************************************************************
+* @file    bench_edge_trigger.cpp
+* @brief   Edge triggered with an I/O budget against level triggered
+*
+* Usage: bench_edge_trigger [seconds] [light connections] [budget] [rx buffer]
+*
+* One SocketServer (epoll) serves a hot connection streaming data as fast
+* as it can, and light connections doing small round trips. Run once level
+* triggered and once edge triggered with the given budget. Reports:
+*  - the hot stream throughput
+*  - the light round trips per second and their p99 latency: a hot peer
+*    must not starve the others
+*  - the server thread system calls per second (epoll_wait rounds and
+*    reads; n/a without access to the tracepoint, see SyscallCounter) and
+*    how often per second it blocked waiting for events.
+*****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "bench_util.hpp"
+#include "sock_server.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+static const size_t PING_SIZE = 64;
+static const size_t STREAM_CHUNK = 64 * 1024;
+static const uint8_t PING = 'P';
+static const uint8_t STREAM = 'S';
+
+
+/*************************************************************************//**
+** Light connections send PING bytes, echoed back; the hot one STREAM
+** bytes, only counted
+*/
+class Sink : public SocketHandler
+{
+public:
+	Sink(SocketServer * const server):
+		SocketHandler(server),
+		received(0)
+	{}
+
+	SocketHandler * on_connect(ConnectionInfo *) {
+		return this;
+	}
+
+	int on_incoming_data(int const fd, const uint8_t * data, size_t size) {
+		received += size;
+		if (data[0] != PING)
+			return 1;
+		while (size > 0) {
+			ssize_t const n = send(fd, data, size, MSG_NOSIGNAL);
+			if (n <= 0)
+				return 0;
+			data += n;
+			size -= n;
+		}
+		return 1;
+	}
+
+	uint64_t received;
+};
+
+
+struct server_ctx {
+	bool edge;
+	unsigned budget;
+	size_t rx_buffer;
+	SocketServer * server;
+	uint16_t port;        // Set once listening
+	bool failed;
+	uint64_t received;
+	bool syscalls_counted;
+	uint64_t syscalls;
+	long wakeups;
+};
+
+struct client_ctx {
+	uint16_t port;
+	bool * stop;
+	vector<uint64_t> latencies;
+	bool failed;
+};
+
+
+/*************************************************************************//**
+**
+*/
+static void * server_thread(void * const arg)
+{
+	server_ctx * const ctx = static_cast<server_ctx *>(arg);
+	SocketServer * const server = new SocketServer();
+	server->set_io_budget(ctx->budget);
+	server->set_rx_buffer_size(ctx->rx_buffer);
+	Sink sink(server);
+	sink.set_edge_triggered(ctx->edge);
+
+	int const sock = server->add_server_socket_ip_stream(&sink, 128, 0, INADDR_LOOPBACK);
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	if ((sock < 0) || (getsockname(sock, (struct sockaddr *)&addr, &len) != 0)) {
+		__atomic_store_n(&ctx->failed, true, __ATOMIC_RELEASE);
+		delete server;
+		return 0;
+	}
+	ctx->server = server;
+
+	SyscallCounter counter;
+	counter.open();
+	long const wakeups = bench_thread_wakeups();
+	__atomic_store_n(&ctx->port, ntohs(addr.sin_port), __ATOMIC_RELEASE);
+
+	server->run();
+
+	ctx->syscalls_counted = counter.is_ready();
+	ctx->syscalls = counter.get_count();
+	ctx->wakeups = bench_thread_wakeups() - wakeups;
+	ctx->received = sink.received;
+	delete server;
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static int connect_loopback(uint16_t const port)
+{
+	int const sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+	int const yes = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static void * hot_thread(void * const arg)
+{
+	client_ctx * const ctx = static_cast<client_ctx *>(arg);
+	int const sock = connect_loopback(ctx->port);
+	ctx->failed = (sock < 0);
+	if (sock < 0)
+		return 0;
+	vector<uint8_t> chunk(STREAM_CHUNK, STREAM);
+	while (!__atomic_load_n(ctx->stop, __ATOMIC_RELAXED)) {
+		if (send(sock, &chunk[0], chunk.size(), MSG_NOSIGNAL) <= 0) {
+			ctx->failed = true;
+			break;
+		}
+	}
+	close(sock);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static void * light_thread(void * const arg)
+{
+	client_ctx * const ctx = static_cast<client_ctx *>(arg);
+	int const sock = connect_loopback(ctx->port);
+	ctx->failed = (sock < 0);
+	if (sock < 0)
+		return 0;
+	uint8_t msg[PING_SIZE];
+	memset(msg, PING, sizeof(msg));
+	while (!__atomic_load_n(ctx->stop, __ATOMIC_RELAXED)) {
+		uint64_t const start = bench_now_ns();
+		if (send(sock, msg, sizeof(msg), MSG_NOSIGNAL) != (ssize_t)sizeof(msg)) {
+			ctx->failed = true;
+			break;
+		}
+		uint8_t echo[PING_SIZE];
+		size_t got = 0;
+		while (got < sizeof(echo)) {
+			ssize_t const n = recv(sock, echo + got, sizeof(echo) - got, 0);
+			if (n <= 0)
+				break;
+			got += n;
+		}
+		if (got < sizeof(echo)) {
+			ctx->failed = true;
+			break;
+		}
+		ctx->latencies.push_back(bench_now_ns() - start);
+	}
+	close(sock);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static int run(bool const edge, unsigned const seconds, unsigned const lights,
+			   unsigned const budget, size_t const rx_buffer)
+{
+	server_ctx sctx;
+	memset(&sctx, 0, sizeof(sctx));
+	sctx.edge = edge;
+	sctx.budget = budget;
+	sctx.rx_buffer = rx_buffer;
+	pthread_t sthread;
+	if (pthread_create(&sthread, 0, server_thread, &sctx) != 0)
+		return -1;
+	while ((__atomic_load_n(&sctx.port, __ATOMIC_ACQUIRE) == 0) &&
+		   !__atomic_load_n(&sctx.failed, __ATOMIC_ACQUIRE))
+		usleep(1000);
+	if (sctx.failed) {
+		pthread_join(sthread, 0);
+		fprintf(stderr, "cannot start the server\n");
+		return -1;
+	}
+
+	bool stop = false;
+	vector<client_ctx> clients(lights + 1);
+	vector<pthread_t> threads(lights + 1);
+	uint64_t const start = bench_now_ns();
+	for (unsigned i = 0; i <= lights; i++) {
+		clients[i].port = sctx.port;
+		clients[i].stop = &stop;
+		pthread_create(&threads[i], 0, (i == 0) ? hot_thread : light_thread, &clients[i]);
+	}
+	sleep(seconds);
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+	// The hot client may be blocked in send() once stopped: the server
+	// keeps reading until it is done
+	for (unsigned i = 0; i <= lights; i++)
+		pthread_join(threads[i], 0);
+	double const elapsed = (bench_now_ns() - start) / 1e9;
+
+	sctx.server->stop();
+	pthread_join(sthread, 0);
+
+	vector<uint64_t> latencies;
+	bool failed = false;
+	for (unsigned i = 0; i <= lights; i++) {
+		latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+		failed = failed || clients[i].failed;
+	}
+	if (failed) {
+		fprintf(stderr, "%s: client error\n", edge ? "edge" : "level");
+		return -1;
+	}
+
+	uint64_t const p99 = bench_percentile(latencies, 99);
+	printf("%-6s %10.1f %10.0f %8.1f ", edge ? "edge" : "level", sctx.received / elapsed / 1e6,
+		   latencies.size() / elapsed, p99 / 1e3);
+	if (sctx.syscalls_counted)
+		printf("%12.0f", sctx.syscalls / elapsed);
+	else
+		printf("%12s", "n/a");
+	printf(" %12.0f\n", sctx.wakeups / elapsed);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	unsigned const seconds = bench_arg(argc, argv, 1, 2);
+	unsigned const lights = bench_arg(argc, argv, 2, 4);
+	unsigned const budget = bench_arg(argc, argv, 3, 16);
+	size_t const rx_buffer = bench_arg(argc, argv, 4, 4096);
+	if ((seconds == 0) || (budget == 0) || (rx_buffer == 0)) {
+		fprintf(stderr, "usage: %s [seconds] [light connections] [budget] [rx buffer]\n", argv[0]);
+		return 1;
+	}
+
+	printf("1 hot stream + %u light connections, budget %u, %zu byte reads, %us per run\n",
+		   lights, budget, rx_buffer, seconds);
+	printf("%-6s %10s %10s %8s %12s %12s\n", "mode", "hot MB/s", "light rt/s", "p99 us",
+		   "syscalls/s", "blocks/s");
+	int res = run(false, seconds, lights, budget, rx_buffer);
+	res |= run(true, seconds, lights, budget, rx_buffer);
+	return (res == 0) ? 0 : 1;
+}
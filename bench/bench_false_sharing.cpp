@@ -0,0 +1,105 @@
+/**
+******************************************************************************
+* @file    bench_false_sharing.cpp
+* @brief   PoolAllocator slab alignment: packed against cache line aligned
+*
+* Usage: bench_false_sharing [threads] [increments per thread]
+*
+* Each thread increments a counter in its own pool object; the objects are
+* allocated one after the other, from a packed pool (neighbours share a
+* cache line), a POOL_CACHE_LINE aligned one, and an aligned one on huge
+* pages. Reports ns per increment: with the threads on different cores the
+* packed pool pays for the cache line bouncing between them. Meaningless
+* with fewer cores than threads, which is reported.
+*****************************************************************************/
+
+#include <pthread.h>
+#include "bench_util.hpp"
+#include "pool_allocator.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+static const unsigned MAX_THREADS = 64;
+
+struct counter {
+	unsigned long value;
+};
+
+struct thread_arg {
+	counter * c;
+	unsigned long increments;
+};
+
+
+/*************************************************************************//**
+** Relaxed atomic increments: each one is a store the other cores see
+*/
+static void * thread_main(void * const arg)
+{
+	thread_arg const * const a = static_cast<thread_arg *>(arg);
+	for (unsigned long i = 0; i < a->increments; i++)
+		__atomic_fetch_add(&a->c->value, 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+
+/*************************************************************************//**
+** @return ns per increment
+*/
+template <size_t ALIGN>
+static double run(char const * const name, uint32_t const flags, unsigned const threads,
+				  unsigned long const increments)
+{
+	PoolAllocator<counter, ALIGN> pool(threads, flags);
+	vector<counter *> objects(threads);
+	for (unsigned i = 0; i < threads; i++) {
+		objects[i] = pool.emplace();
+		objects[i]->value = 0;
+	}
+
+	vector<pthread_t> tids(threads);
+	vector<thread_arg> args(threads);
+	uint64_t const start = bench_now_ns();
+	for (unsigned i = 0; i < threads; i++) {
+		args[i].c = objects[i];
+		args[i].increments = increments;
+		pthread_create(&tids[i], 0, thread_main, &args[i]);
+	}
+	for (unsigned i = 0; i < threads; i++)
+		pthread_join(tids[i], 0);
+	uint64_t const elapsed = bench_now_ns() - start;
+
+	double const ns = (double)elapsed / increments;
+	printf("%-8s %6zu %10.2f\n", name, pool.get_slab_size(), ns);
+	for (unsigned i = 0; i < threads; i++)
+		pool.free_object(objects[i]);
+	return ns;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned const threads = bench_arg(argc, argv, 1, (cpus > 4) ? 4 : ((cpus > 1) ? cpus : 2));
+	unsigned long const increments = bench_arg(argc, argv, 2, 50000000);
+	if ((threads < 2) || (threads > MAX_THREADS) || (increments == 0)) {
+		fprintf(stderr, "usage: %s [threads 2..%u] [increments per thread]\n", argv[0], MAX_THREADS);
+		return 1;
+	}
+
+	printf("%u threads, %lu increments each, %ld cpus\n", threads, increments, cpus);
+	if (cpus < (long)threads)
+		printf("fewer cpus than threads: the threads take turns on a core, no false sharing to see\n");
+	printf("%-8s %6s %10s\n", "pool", "slab", "ns/incr");
+	typedef PoolAllocator<counter, POOL_CACHE_LINE> AlignedPool;
+	double const packed = run<0>("packed", 0, threads, increments);
+	double const aligned = run<POOL_CACHE_LINE>("aligned", 0, threads, increments);
+	run<POOL_CACHE_LINE>("huge", AlignedPool::POOL_HUGE_PAGES, threads, increments);
+	printf("aligned speedup %.2f\n", packed / aligned);
+	return 0;
+}
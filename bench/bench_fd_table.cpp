@@ -0,0 +1,136 @@
+/**
+******************************************************************************
+* @file    bench_fd_table.cpp
+* @brief   EPollDescManager add / lookup / remove at 10k and 100k descriptors
+*
+* Usage: bench_fd_table [rounds] [descriptor counts...]
+*
+* Registers N eventfds, looks each of them up (get_fd_udata()), then
+* removes them in random order, N times 10k and 100k by default. Reports
+* the cost per operation: it should not grow with N, add and remove being
+* mostly the epoll_ctl() call. The open file limit is raised as needed;
+* counts above the hard limit are skipped.
+*****************************************************************************/
+
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include "bench_util.hpp"
+#include "epoll_fds_mgr.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+/*************************************************************************//**
+** @return 0 if @a count more descriptors can be opened
+*/
+static int reserve_fds(size_t const count)
+{
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) != 0)
+		return -1;
+	rlim_t const needed = count + 64;
+	if (rl.rlim_cur >= needed)
+		return 0;
+	if ((rl.rlim_max != RLIM_INFINITY) && (rl.rlim_max < needed))
+		return -1;
+	rl.rlim_cur = needed;
+	return setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+
+/*************************************************************************//**
+**
+*/
+static int run(size_t const count, unsigned const rounds)
+{
+	if (reserve_fds(count) != 0) {
+		printf("%8zu skipped: open file limit too low\n", count);
+		return 0;
+	}
+
+	vector<int> fds(count);
+	for (size_t i = 0; i < count; i++) {
+		fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fds[i] < 0) {
+			fprintf(stderr, "eventfd error after %zu descriptors\n", i);
+			for (size_t j = 0; j < i; j++)
+				close(fds[j]);
+			return -1;
+		}
+	}
+
+	EPollDescManager mgr;
+	vector<int> order(fds);
+	uint64_t add_ns = 0;
+	uint64_t find_ns = 0;
+	uint64_t rem_ns = 0;
+	size_t misses = 0;
+	int res = 0;
+	srand(1);
+
+	for (unsigned r = 0; (r < rounds) && (res == 0); r++) {
+		uint64_t t0 = bench_now_ns();
+		for (size_t i = 0; i < count; i++) {
+			if (mgr.add_fd(fds[i], EPOLLIN, &fds[i], 0) != 0) {
+				res = -1;
+				break;
+			}
+		}
+		uint64_t t1 = bench_now_ns();
+		add_ns += t1 - t0;
+
+		for (size_t i = 0; i < count; i++)
+			if (mgr.get_fd_udata(fds[i]) != &fds[i])
+				misses++;
+		uint64_t t2 = bench_now_ns();
+		find_ns += t2 - t1;
+
+		// Connections don't go away in the order they came
+		for (size_t i = count - 1; i > 0; i--)
+			swap(order[i], order[rand() % (i + 1)]);
+		t2 = bench_now_ns();
+		for (size_t i = 0; i < count; i++)
+			mgr.rem_fd(order[i], 0);
+		rem_ns += bench_now_ns() - t2;
+	}
+
+	for (size_t i = 0; i < count; i++)
+		close(fds[i]);
+	if ((res != 0) || (misses != 0)) {
+		fprintf(stderr, "%zu descriptors: add error or %zu lookup misses\n", count, misses);
+		return -1;
+	}
+
+	double const ops = (double)count * rounds;
+	printf("%8zu %10.1f %10.1f %10.1f %12.0f %12.0f\n", count,
+		   add_ns / ops, find_ns / ops, rem_ns / ops, ops * 1e9 / add_ns, ops * 1e9 / rem_ns);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	unsigned const rounds = bench_arg(argc, argv, 1, 5);
+	if (rounds == 0) {
+		fprintf(stderr, "usage: %s [rounds] [descriptor counts...]\n", argv[0]);
+		return 1;
+	}
+	vector<size_t> counts;
+	for (int i = 2; i < argc; i++)
+		counts.push_back(strtoul(argv[i], 0, 0));
+	if (counts.empty()) {
+		counts.push_back(10000);
+		counts.push_back(100000);
+	}
+
+	printf("%u rounds\n", rounds);
+	printf("%8s %10s %10s %10s %12s %12s\n", "fds", "add ns", "find ns", "rem ns", "adds/s", "removes/s");
+	int res = 0;
+	for (size_t i = 0; i < counts.size(); i++)
+		res |= run(counts[i], rounds);
+	return (res == 0) ? 0 : 1;
+}
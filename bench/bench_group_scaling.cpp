@@ -0,0 +1,228 @@
+/**
+******************************************************************************
+* @file    bench_group_scaling.cpp
+* @brief   SocketServerGroup loopback echo throughput, 1 to N reactors
+*
+* Usage: bench_group_scaling [max reactors] [client threads]
+*                            [connections per client] [seconds] [port]
+*
+* For 1, 2, 4... up to max reactors, a group echoes what it receives on a
+* SO_REUSEPORT loopback port. Every client thread keeps one small message in
+* flight on each of its connections for the given time. Reports the round
+* trips per second and the speedup over a single reactor. On a host with
+* fewer cores than reactors + client threads the figures only show the
+* overhead of the extra threads.
+*****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "bench_util.hpp"
+#include "sock_server_group.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+static const size_t MESSAGE_SIZE = 64;
+
+
+/*************************************************************************//**
+** Listener of one reactor, also serving the connections it accepts
+*/
+class EchoListener : public SocketHandler
+{
+public:
+	EchoListener(SocketServer * const server, uint16_t const port):
+		SocketHandler(server)
+	{
+		service.set_inet_conn_data(INADDR_LOOPBACK, port, 512);
+		service.fill_addrinfo(SOCK_STREAM, IPPROTO_TCP);
+	}
+
+	ServiceInfo * get_service_info() {
+		return &service;
+	}
+
+	SocketHandler * on_connect(ConnectionInfo *) {
+		return this;
+	}
+
+	int on_incoming_data(int const fd, const uint8_t * data, size_t size) {
+		while (size > 0) {
+			ssize_t const n = send(fd, data, size, MSG_NOSIGNAL);
+			if (n <= 0)
+				return 0;
+			data += n;
+			size -= n;
+		}
+		return 1;
+	}
+
+private:
+	INETv4ServiceInfo service;
+};
+
+
+class EchoFactory : public SocketServerGroup::ListenerFactory
+{
+public:
+	EchoFactory(uint16_t const port):
+		port(port)
+	{}
+
+	SocketHandler * create_listener(SocketServer * const server, unsigned) {
+		return new EchoListener(server, port);
+	}
+
+private:
+	uint16_t port;
+};
+
+
+struct client_ctx {
+	uint16_t port;
+	unsigned connections;
+	bool * stop;
+	uint64_t round_trips;
+	bool failed;
+};
+
+
+/*************************************************************************//**
+** Send on every connection, then collect every echo: one message in flight
+** per connection
+*/
+static void * client_thread(void * const arg)
+{
+	client_ctx * const ctx = static_cast<client_ctx *>(arg);
+	vector<int> socks;
+	ctx->failed = true;
+
+	for (unsigned i = 0; i < ctx->connections; i++) {
+		int const sock = socket(AF_INET, SOCK_STREAM, 0);
+		if (sock < 0)
+			break;
+		int const yes = 1;
+		setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(ctx->port);
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+			close(sock);
+			break;
+		}
+		socks.push_back(sock);
+	}
+
+	uint8_t msg[MESSAGE_SIZE];
+	memset(msg, 'x', sizeof(msg));
+	bool ok = (socks.size() == ctx->connections);
+	while (ok && !__atomic_load_n(ctx->stop, __ATOMIC_RELAXED)) {
+		for (size_t i = 0; (i < socks.size()) && ok; i++)
+			ok = (send(socks[i], msg, sizeof(msg), MSG_NOSIGNAL) == (ssize_t)sizeof(msg));
+		for (size_t i = 0; (i < socks.size()) && ok; i++) {
+			uint8_t echo[MESSAGE_SIZE];
+			size_t got = 0;
+			while (got < sizeof(echo)) {
+				ssize_t const n = recv(socks[i], echo + got, sizeof(echo) - got, 0);
+				if (n <= 0)
+					break;
+				got += n;
+			}
+			ok = (got == sizeof(echo));
+		}
+		if (ok)
+			ctx->round_trips += socks.size();
+	}
+	ctx->failed = !ok;
+
+	for (size_t i = 0; i < socks.size(); i++)
+		close(socks[i]);
+	return 0;
+}
+
+
+/*************************************************************************//**
+** @return round trips per second, < 0 on error
+*/
+static double run(unsigned const reactors, unsigned const clients, unsigned const connections,
+				  unsigned const seconds, uint16_t const port)
+{
+	SocketServerGroup group(reactors);
+	EchoFactory factory(port);
+	if (group.start(&factory) != 0) {
+		fprintf(stderr, "cannot start %u reactors on port %u\n", reactors, port);
+		return -1;
+	}
+
+	bool stop = false;
+	vector<client_ctx> ctx(clients);
+	vector<pthread_t> threads(clients);
+	uint64_t const start = bench_now_ns();
+	for (unsigned i = 0; i < clients; i++) {
+		ctx[i].port = port;
+		ctx[i].connections = connections;
+		ctx[i].stop = &stop;
+		ctx[i].round_trips = 0;
+		pthread_create(&threads[i], 0, client_thread, &ctx[i]);
+	}
+	sleep(seconds);
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+	uint64_t round_trips = 0;
+	bool failed = false;
+	for (unsigned i = 0; i < clients; i++) {
+		pthread_join(threads[i], 0);
+		round_trips += ctx[i].round_trips;
+		failed = failed || ctx[i].failed;
+	}
+	uint64_t const elapsed = bench_now_ns() - start;
+	group.stop();
+
+	if (failed) {
+		fprintf(stderr, "%u reactors: client error\n", reactors);
+		return -1;
+	}
+	return round_trips * 1e9 / elapsed;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	long const cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned const max_reactors = bench_arg(argc, argv, 1, (cpus > 1) ? cpus : 1);
+	unsigned const clients = bench_arg(argc, argv, 2, 4);
+	unsigned const connections = bench_arg(argc, argv, 3, 16);
+	unsigned const seconds = bench_arg(argc, argv, 4, 2);
+	uint16_t const port = bench_arg(argc, argv, 5, 18006);
+	if ((max_reactors == 0) || (clients == 0) || (connections == 0) || (seconds == 0)) {
+		fprintf(stderr, "usage: %s [max reactors] [client threads] [connections per client] [seconds] [port]\n",
+				argv[0]);
+		return 1;
+	}
+
+	printf("%ld cpus, %u client threads x %u connections, %zu byte messages, %us per run\n",
+		   cpus, clients, connections, MESSAGE_SIZE, seconds);
+	printf("%8s %12s %8s\n", "reactors", "req/s", "speedup");
+	double base = 0;
+	for (unsigned n = 1; ; n = min(n * 2, max_reactors)) {
+		double const rate = run(n, clients, connections, seconds, port);
+		if (rate < 0)
+			return 1;
+		if (n == 1)
+			base = rate;
+		printf("%8u %12.0f %8.2f\n", n, rate, (base > 0) ? rate / base : 0);
+		if (n == max_reactors)
+			break;
+	}
+	return 0;
+}
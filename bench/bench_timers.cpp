@@ -0,0 +1,133 @@
+/**
+******************************************************************************
+* @file    bench_timers.cpp
+* @brief   TimerPool stress: start and stop 100k timers
+*
+* Usage: bench_timers [timers] [rounds]
+*
+* Starts the timers (timeouts spread over a minute), then releases them in
+* random order, a few rounds; then lets as many short timers expire through
+* the server event loop. Reports the cost per start, release and expiry,
+* the pool capacity and the resident memory growth.
+*****************************************************************************/
+
+#include "bench_util.hpp"
+#include "sock_server.hpp"
+#include "timer_pool.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+/*************************************************************************//**
+**
+*/
+static long resident_kb()
+{
+	FILE * const f = fopen("/proc/self/statm", "r");
+	if (f == 0)
+		return -1;
+	long size = 0;
+	long resident = 0;
+	int const n = fscanf(f, "%ld %ld", &size, &resident);
+	fclose(f);
+	if (n != 2)
+		return -1;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+
+/*************************************************************************//**
+** Timer target: counts expiries, stops the server after the last one
+*/
+class Target
+{
+public:
+	Target(SocketServer * const server):
+		server(server),
+		expired(0),
+		expected(0)
+	{}
+
+	void on_timer() {
+		if (++expired == expected)
+			server->stop();
+	}
+
+	SocketServer * server;
+	size_t expired;
+	size_t expected;
+};
+
+typedef TimerPool<Target> BenchTimerPool;
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	size_t const count = bench_arg(argc, argv, 1, 100000);
+	unsigned const rounds = bench_arg(argc, argv, 2, 5);
+	if ((count == 0) || (rounds == 0)) {
+		fprintf(stderr, "usage: %s [timers] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	SocketServer server;
+	Target target(&server);
+	long const rss0 = resident_kb();
+	BenchTimerPool * const pool = new BenchTimerPool(4);
+	if (pool->initialize(&server, &target) != 0)
+		return 1;
+
+	vector<aptimer_t> timers(count);
+	uint64_t start_ns = 0;
+	uint64_t release_ns = 0;
+	unsigned peak_slabs = 0;
+	long peak_rss = 0;
+	srand(1);
+	for (unsigned r = 0; r < rounds; r++) {
+		uint64_t const t0 = bench_now_ns();
+		for (size_t i = 0; i < count; i++) {
+			timers[i] = pool->start_oneshot(1000 + (int)(i % 59000), &Target::on_timer);
+			if (timers[i] == 0) {
+				fprintf(stderr, "start failed at %zu timers\n", i);
+				return 1;
+			}
+		}
+		uint64_t const t1 = bench_now_ns();
+		start_ns += t1 - t0;
+		peak_slabs = max(peak_slabs, pool->get_pool_size());
+		peak_rss = max(peak_rss, resident_kb());
+
+		for (size_t i = count - 1; i > 0; i--)
+			swap(timers[i], timers[rand() % (i + 1)]);
+		uint64_t const t2 = bench_now_ns();
+		for (size_t i = 0; i < count; i++)
+			pool->release(timers[i]);
+		release_ns += bench_now_ns() - t2;
+	}
+	unsigned const idle_slabs = pool->get_pool_size();
+
+	// Expiries, 1 to 50 ms from now
+	target.expected = count;
+	for (size_t i = 0; i < count; i++)
+		timers[i] = pool->start_oneshot(1 + (int)(i % 50), &Target::on_timer);
+	uint64_t const t3 = bench_now_ns();
+	server.run();
+	uint64_t const run_ns = bench_now_ns() - t3;
+	for (size_t i = 0; i < count; i++)
+		pool->release(timers[i]);
+
+	double const ops = (double)count * rounds;
+	printf("%zu timers, %u rounds\n", count, rounds);
+	printf("start     %8.1f ns\n", start_ns / ops);
+	printf("release   %8.1f ns\n", release_ns / ops);
+	printf("expiry    %zu of %zu in %.1f ms (timeouts up to 50 ms)\n", target.expired, count, run_ns / 1e6);
+	printf("pool      %u slabs of %zu bytes at peak, %u once released\n",
+		   peak_slabs, sizeof(timer_block<Target>), idle_slabs);
+	printf("resident  +%ld kB at peak\n", peak_rss - rss0);
+	delete pool;
+	return (target.expired == count) ? 0 : 1;
+}
@@ -0,0 +1,255 @@
+/**
+******************************************************************************
+* @file    bench_uring_loopback.cpp
+* @brief   Loopback echo round trips: io_uring backend against epoll
+*
+* Usage: bench_uring_loopback [requests per connection] [connections] [size]
+*
+* One SocketServer thread echoes what it receives; each connection is a
+* client thread sending a message and waiting for its echo. Reports the
+* throughput, the round trip latency percentiles and the system calls made
+* by the server thread per request (see SyscallCounter).
+*****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "bench_util.hpp"
+#include "sock_server.hpp"
+#include "uring_event_mgr.hpp"
+
+#include "logging.hpp"
+_INITIALIZE_EASYLOGGINGPP
+
+
+/*************************************************************************//**
+** Echo every chunk received back to its sender
+*/
+class EchoHandler : public SocketHandler
+{
+public:
+	EchoHandler(SocketServer * const server):
+		SocketHandler(server)
+	{}
+
+	SocketHandler * on_connect(ConnectionInfo *) {
+		return this;
+	}
+
+	int on_incoming_data(int const fd, const uint8_t * data, size_t size) {
+		while (size > 0) {
+			ssize_t const n = send(fd, data, size, MSG_NOSIGNAL);
+			if (n <= 0)
+				return 0;
+			data += n;
+			size -= n;
+		}
+		return 1;
+	}
+};
+
+
+struct server_ctx {
+	IOEventManager::backend_type backend;
+	SocketServer * server;
+	uint16_t port;        // Set once listening
+	bool failed;
+	bool syscalls_counted;
+	uint64_t syscalls;
+	long wakeups;
+};
+
+struct client_ctx {
+	uint16_t port;
+	unsigned requests;
+	size_t size;
+	vector<uint64_t> latencies;
+	bool failed;
+};
+
+
+/*************************************************************************//**
+** The server is created on its own thread: the event manager and the
+** per server objects belong to the thread running it
+*/
+static void * server_thread(void * const arg)
+{
+	server_ctx * const ctx = static_cast<server_ctx *>(arg);
+	SocketServer * const server = new SocketServer(ctx->backend);
+	EchoHandler handler(server);
+
+	int const sock = server->add_server_socket_ip_stream(&handler, 128, 0, INADDR_LOOPBACK);
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	if ((sock < 0) || (getsockname(sock, (struct sockaddr *)&addr, &len) != 0)) {
+		__atomic_store_n(&ctx->failed, true, __ATOMIC_RELEASE);
+		delete server;
+		return 0;
+	}
+	ctx->server = server;
+
+	SyscallCounter counter;
+	counter.open();
+	long const wakeups = bench_thread_wakeups();
+	__atomic_store_n(&ctx->port, ntohs(addr.sin_port), __ATOMIC_RELEASE);
+
+	server->run();
+
+	ctx->syscalls_counted = counter.is_ready();
+	ctx->syscalls = counter.get_count();
+	ctx->wakeups = bench_thread_wakeups() - wakeups;
+	delete server;
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static void * client_thread(void * const arg)
+{
+	client_ctx * const ctx = static_cast<client_ctx *>(arg);
+	ctx->failed = true;
+
+	int const sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock < 0)
+		return 0;
+	int const yes = 1;
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(ctx->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(sock);
+		return 0;
+	}
+
+	vector<uint8_t> msg(ctx->size, 'x');
+	vector<uint8_t> echo(ctx->size);
+	ctx->latencies.reserve(ctx->requests);
+	for (unsigned i = 0; i < ctx->requests; i++) {
+		uint64_t const start = bench_now_ns();
+		if (send(sock, &msg[0], msg.size(), MSG_NOSIGNAL) != (ssize_t)msg.size())
+			break;
+		size_t got = 0;
+		while (got < echo.size()) {
+			ssize_t const n = recv(sock, &echo[got], echo.size() - got, 0);
+			if (n <= 0)
+				break;
+			got += n;
+		}
+		if (got < echo.size())
+			break;
+		ctx->latencies.push_back(bench_now_ns() - start);
+	}
+	ctx->failed = (ctx->latencies.size() != ctx->requests);
+	close(sock);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+static int run(char const * const name, IOEventManager::backend_type const backend,
+			   unsigned const requests, unsigned const connections, size_t const size)
+{
+	server_ctx sctx;
+	memset(&sctx, 0, sizeof(sctx));
+	sctx.backend = backend;
+	pthread_t sthread;
+	if (pthread_create(&sthread, 0, server_thread, &sctx) != 0)
+		return -1;
+	while ((__atomic_load_n(&sctx.port, __ATOMIC_ACQUIRE) == 0) &&
+		   !__atomic_load_n(&sctx.failed, __ATOMIC_ACQUIRE))
+		usleep(1000);
+	if (sctx.failed) {
+		pthread_join(sthread, 0);
+		fprintf(stderr, "%s: cannot start the server\n", name);
+		return -1;
+	}
+
+	vector<client_ctx> clients(connections);
+	vector<pthread_t> cthreads(connections);
+	uint64_t const start = bench_now_ns();
+	for (unsigned i = 0; i < connections; i++) {
+		clients[i].port = sctx.port;
+		clients[i].requests = requests;
+		clients[i].size = size;
+		pthread_create(&cthreads[i], 0, client_thread, &clients[i]);
+	}
+	for (unsigned i = 0; i < connections; i++)
+		pthread_join(cthreads[i], 0);
+	uint64_t const elapsed = bench_now_ns() - start;
+
+	sctx.server->stop();
+	pthread_join(sthread, 0);
+
+	vector<uint64_t> latencies;
+	bool failed = false;
+	for (unsigned i = 0; i < connections; i++) {
+		latencies.insert(latencies.end(), clients[i].latencies.begin(), clients[i].latencies.end());
+		failed = failed || clients[i].failed;
+	}
+	size_t const total = latencies.size();
+	if (failed || (total == 0)) {
+		fprintf(stderr, "%s: %zu of %u round trips completed\n", name, total, requests * connections);
+		return -1;
+	}
+
+	uint64_t const p50 = bench_percentile(latencies, 50);
+	uint64_t const p99 = bench_percentile(latencies, 99);
+	printf("%-9s %10zu %10.0f %8.1f %8.1f %8.1f ", name, total, total * 1e9 / elapsed,
+		   p50 / 1e3, p99 / 1e3, latencies.back() / 1e3);
+	if (sctx.syscalls_counted)
+		printf("%12.2f", (double)sctx.syscalls / total);
+	else
+		printf("%12s", "n/a");
+	printf(" %11.2f\n", (double)sctx.wakeups / total);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int main(int argc, char * argv[])
+{
+	unsigned const requests = bench_arg(argc, argv, 1, 20000);
+	unsigned const connections = bench_arg(argc, argv, 2, 4);
+	size_t const size = bench_arg(argc, argv, 3, 64);
+	if ((requests == 0) || (connections == 0) || (size == 0)) {
+		fprintf(stderr, "usage: %s [requests per connection] [connections] [size]\n", argv[0]);
+		return 1;
+	}
+
+	printf("%u connections x %u round trips of %zu bytes\n", connections, requests, size);
+	printf("%-9s %10s %10s %8s %8s %8s %12s %11s\n", "backend", "requests", "req/s",
+		   "p50 us", "p99 us", "max us", "syscalls/req", "wakeups/req");
+
+	int res = run("epoll", IOEventManager::BACKEND_EPOLL, requests, connections, size);
+
+#ifdef HAVE_IO_URING
+	bool uring_ready;
+	{
+		URingEventManager probe;
+		uring_ready = probe.is_ready();
+	}
+	if (uring_ready)
+		res |= run("io_uring", IOEventManager::BACKEND_IO_URING, requests, connections, size);
+	else
+		printf("io_uring: not supported by this kernel\n");
+#else
+	printf("io_uring: not supported by the kernel headers\n");
+#endif
+
+	bool const counted = SyscallCounter().open() == 0;
+	if (!counted)
+		printf("syscalls/req n/a: no access to the raw_syscalls tracepoint, run under \"strace -c -f\"\n");
+	return (res == 0) ? 0 : 1;
+}
@@ -0,0 +1,171 @@
+/**
+******************************************************************************
+* @file    bench_util.hpp
+* @brief   Helpers shared by the benchmarks: clock, percentiles, counters
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+* Benchmarks are not built by default: "make bench", see CMakeLists.txt.
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __BENCH_UTIL_HPP_INCLUDED
+#define __BENCH_UTIL_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error bench_util.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+
+/*************************************************************************//**
+**
+*/
+static inline uint64_t bench_now_ns()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+
+/*************************************************************************//**
+** @a p: 0..100; sorts @a samples
+*/
+static inline uint64_t bench_percentile(vector<uint64_t> & samples, double const p)
+{
+	if (samples.empty())
+		return 0;
+	sort(samples.begin(), samples.end());
+	size_t i = (size_t)(p / 100.0 * (samples.size() - 1) + 0.5);
+	return samples[min(i, samples.size() - 1)];
+}
+
+
+/*************************************************************************//**
+** Integer argument @a index of the command line, @a def if missing
+*/
+static inline unsigned long bench_arg(int const argc, char * const argv[], int const index, unsigned long const def)
+{
+	if (index >= argc)
+		return def;
+	return strtoul(argv[index], 0, 0);
+}
+
+
+/*************************************************************************//**
+** Voluntary context switches of the calling thread: how often it blocked
+*/
+static inline long bench_thread_wakeups()
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_THREAD, &ru) != 0)
+		return -1;
+	return ru.ru_nvcsw;
+}
+
+
+/*************************************************************************//**
+**
+** System calls made by the thread that opened the counter, counted by the
+** raw_syscalls:sys_enter tracepoint. Needs tracefs and the permission to
+** use it (perf_event_paranoid, CAP_PERFMON): is_ready() is false otherwise,
+** count the calls with "strace -c -f" instead.
+**
+*****************************************************************************/
+
+class SyscallCounter
+{
+public:
+	SyscallCounter():
+		fd(-1)
+	{}
+
+	~SyscallCounter() {
+		if (fd >= 0)
+			close(fd);
+	}
+
+	/**
+	 * Count the calls of the calling thread from now on
+	 * @return 0 on success, -1 if not available
+	 */
+	int open() {
+		static const char * const paths[] = {
+			"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+			"/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"
+		};
+		unsigned long long id = 0;
+		bool found = false;
+		for (size_t i = 0; (i < sizeof(paths) / sizeof(paths[0])) && !found; i++) {
+			FILE * const f = fopen(paths[i], "r");
+			if (f == 0)
+				continue;
+			found = (fscanf(f, "%llu", &id) == 1);
+			fclose(f);
+		}
+		if (!found)
+			return -1;
+
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.config = id;
+		attr.sample_period = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		return (fd >= 0) ? 0 : -1;
+	}
+
+	bool is_ready() const {
+		return fd >= 0;
+	}
+
+	uint64_t get_count() const {
+		uint64_t count = 0;
+		if ((fd < 0) || (read(fd, &count, sizeof(count)) != sizeof(count)))
+			return 0;
+		return count;
+	}
+
+private:
+	SyscallCounter(SyscallCounter const &);
+	SyscallCounter & operator=(SyscallCounter const &);
+
+private:
+	int fd;
+};
+
+
+/****************************************************************************/
+
+#endif /* __BENCH_UTIL_HPP_INCLUDED */
+/* EOF */
@@ -12,9 +12,14 @@
 #include "version.h"
 #include "appl.hpp"
 #include "fileutility.hpp"
+#include "metrics_registry.hpp"
 
 #define LOG_SUBSYSTEM_ID "default"
 
+#define APPL_FLUSH_MS       1000    // Scrittura file di stato modificato
+#define APPL_STAT_COALESCE_MS 30000 // Sync del journal / scrittura delle modifiche raggruppate
+#define APPL_METRICS_MS     60000   // Log delle metriche (verbosita' 1)
+
 //////////////////////////////////////////////////////////////////////////////
 //                     C L A S S    M E T H O D S                           //
 //////////////////////////////////////////////////////////////////////////////
@@ -34,8 +39,13 @@ APPL::APPL()
 /////////////////////////////////////////////////////////////////////////////
 APPL::~APPL()
 {
-    if (m_pstat)
+    if (m_pstat) {
+        m_pstat->flush(true);
         delete m_pstat;
+    }
+	// Dopo i file che lo usano
+	if (m_writer)
+		delete m_writer;
     
 	if (m_timers)
 		delete m_timers;
@@ -65,28 +75,27 @@ bool APPL::init()
     static char version[40];
     snprintf(version, 40, "%d.%d", VERSION_MAJOR_APPLICATIVE, VERSION_MINOR_APPLICATIVE);
     m_pstat = new ApplConfigFile("appl.stat");
+    m_pstat->set_flush_interval(APPL_STAT_COALESCE_MS);
+    m_pstat->enable_journal();
+    // Scritture su file fuori dal thread del server
+    m_writer = new ConfigWriter;
+    if (m_writer->start() == 0)
+        m_pstat->set_writer(m_writer);
     m_pstat->put("ver_appl_appl", version);
 	
-	m_timers = new ApplTimerPool(4);
-	if (m_timers->initialize(APPL_TIMERS_SIGNAL, this) == -1) {
-		ERROR() << "Timers initialization error";
-		return false;
-	}
-	
 	// Init TCP socket protocol
 	m_SockSrv = new SocketServer();
-	m_SockSrv->set_poll_timeout_us(5000); // 200Hz
 	
-	sigset_t sigmask;
-	sigemptyset(&sigmask);
-	sigaddset(&sigmask, APPL_TIMERS_SIGNAL);
-	m_sigh = new ApplSigHandler(m_SockSrv, this);
-	if (m_SockSrv->add_signal_handler(m_sigh, &sigmask) == -1) {
-		ERROR() << "Cannot install ApplSigHandler";
+	// Timers run on the server's event loop
+	m_timers = new ApplTimerPool(4);
+	if (m_timers->initialize(m_SockSrv, this) == -1) {
+		ERROR() << "Timers initialization error";
 		return false;
 	}
 
 	m_timerLed = m_timers->start_periodic(1000, &APPL::on_timer_led);
+	m_timerFlush = m_timers->start_periodic(APPL_FLUSH_MS, &APPL::on_timer_flush);
+	m_timerMetrics = m_timers->start_periodic(APPL_METRICS_MS, &APPL::on_timer_metrics);
 
     m_pAppl2 = new APPL2;
     if (m_pAppl2 == 0) {
@@ -110,11 +119,32 @@ bool APPL::init()
 /////////////////////////////////////////////////////////////////////////////
 bool APPL::run()
 {
-    if (m_pstat && m_pstat->is_changed())
-        m_pstat->write();
-    
-	m_SockSrv->process_connections();
-	return running;
+	if (m_SockSrv == 0)
+		return false;
+	
+	int res = m_SockSrv->run();
+	running = false;
+	return (res == 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void APPL::stop()
+{
+	if (m_SockSrv)
+		m_SockSrv->stop();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void APPL::on_timer_flush()
+{
+    if (m_pstat)
+        m_pstat->flush();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void APPL::on_timer_metrics()
+{
+	MetricsRegistry::instance().dump();
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -132,4 +162,9 @@ void APPL::on_timer_led()
         
         m_pstat->put("counter", m_cntLed);
     }
+    
+    if (m_pAppl2) {
+        appl_msg msg = { APPL_MSG_LED_COUNTER, m_cntLed };
+        m_pAppl2->post_message(msg);
+    }
 }
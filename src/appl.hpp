@@ -28,13 +28,9 @@
 #include <timer_pool.hpp>
 #include <sock_server.hpp>
 #include "applConfigFile.hpp"
+#include "config_writer.hpp"
 #include "appl2.hpp"
 
-/////////////////////////////////////////////////////////////////////////////
-//
-/////////////////////////////////////////////////////////////////////////////
-#define APPL_TIMERS_SIGNAL   ((unsigned)(SIGRTMIN+3))
-
 /////////////////////////////////////////////////////////////////////////////
 /// Classe: gestione applicativo.
 ///
@@ -59,50 +55,34 @@ public:
 	///				false= avvio errato
 	bool init();
 	
-	/// Loop di main dell'applicativo
+	/// Loop di main dell'applicativo: ritorna solo dopo stop()
 	///
 	/// \return		true= run corretto \n
 	///				false= run errato
 	bool run();
-
-protected:
-	class ApplSigHandler : public SocketHandler {
-	public:
-		ApplSigHandler(SocketServer * const server, APPL * const app):
-			SocketHandler(server),
-			m_appl(app)
-		{}
-	
-		int on_signal(int fd, uint32_t sig, void *uptr) {
-			(void)fd;
-			if (sig == APPL_TIMERS_SIGNAL)
-				m_appl->handle_timers_signal(reinterpret_cast<aptimer_t>(uptr));
-			return 0;
-		}
-	
-	private:
-		APPL *m_appl;
-	};
-	
-	void handle_timers_signal(aptimer_t elapsed_timer) {
-		ApplTimerPool::call_handler(elapsed_timer);
-	}
 	
+	/// Termina run(); chiamabile anche da un signal handler
+	void stop();
+
 private:
 	void on_timer_led();
+	void on_timer_flush();
+	void on_timer_metrics();
 	
 //--- Variabili ---
 protected:
 	bool running;
 	
 	SocketServer        *m_SockSrv;
-	ApplSigHandler      *m_sigh;
 	
 private:
 	ApplTimerPool       *m_timers;
 	aptimer_t 		    m_timerLed;
+	aptimer_t 		    m_timerFlush;
+	aptimer_t 		    m_timerMetrics;
     
     ApplConfigFile      *m_pstat;
+    ConfigWriter        *m_writer;
     
     APPL2               *m_pAppl2;
 };
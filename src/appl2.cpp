@@ -30,17 +30,22 @@ APPL2::APPL2()
 /////////////////////////////////////////////////////////////////////////////
 APPL2::~APPL2()
 {
+    // The thread uses server and timers until its loop has stopped
+    if (m_thread_created) {
+        _VBL(1) << "Joining APPL2 Management thread";
+        m_SockSrv->stop();
+        pthread_join(m_thread, 0);
+    }
+    
+	if (m_channel)
+		delete m_channel;
+
 	if (m_timers)
 		delete m_timers;
 
 	if (m_SockSrv)
 		delete m_SockSrv;
 	
-    if (m_thread_created) {
-        _VBL(1) << "Joining APPL2 Management thread";
-        pthread_join(m_thread, 0);
-    }
-    
 	running = false;
 }
 
@@ -62,10 +67,8 @@ void *appl2_thread_trampoline(APPL2 *obj)
     _VBL(1) << "APPL2 main thread started ID:" << HEX(pthread_self(), sizeof(pthread_t)*2);
     //obj->m_state_mutex.unlock();
 
-    do {
-        r = obj->run_thread();
-        //_VBL(4) << "MiWi state: " << obj->get_state();
-    } while(r);
+    r = obj->run_thread();
+    _VBL(1) << "APPL2 main thread ended " << (r ? "normally" : "with error");
     
     return 0;
 }
@@ -75,27 +78,24 @@ bool APPL2::init()
 {
     int res;
     
-    m_timers = new ApplTimerPool(4);
-    if (m_timers->initialize(APPL_TIMERS_SIGNAL, this) == -1) {
-        ERROR() << "Timers initialization error";
-        return false;
-    }
-    
     // Init TCP socket protocol
     m_SockSrv = new SocketServer();
-    m_SockSrv->set_poll_timeout_us(5000); // 200Hz
     
-    sigset_t sigmask;
-    sigemptyset(&sigmask);
-    sigaddset(&sigmask, APPL_TIMERS_SIGNAL);
-    m_sigh = new ApplSigHandler(m_SockSrv, this);
-    if (m_SockSrv->add_signal_handler(m_sigh, &sigmask) == -1) {
-        ERROR() << "Cannot install ApplSigHandler";
+    // Timers run on the server's event loop
+    m_timers = new ApplTimerPool(4);
+    if (m_timers->initialize(m_SockSrv, this) == -1) {
+        ERROR() << "Timers initialization error";
         return false;
     }
 
     m_timerLed = m_timers->start_periodic(5000, &APPL2::on_timer);
     
+    // Messages from the other threads
+    m_channel = new ApplChannel(m_SockSrv, this);
+    if (!m_channel->is_ready()) {
+        ERROR() << "Message channel initialization error";
+        return false;
+    }
 
     //m_state_mutex.lock();
     res = pthread_create(&m_thread, NULL,
@@ -119,22 +119,13 @@ unlock_cleanup_error_exit:
 /////////////////////////////////////////////////////////////////////////////
 bool APPL2::init()
 {
-	m_timers = new ApplTimerPool(4);
-	if (m_timers->initialize(APPL_TIMERS_SIGNAL, this) == -1) {
-		ERROR() << "Timers initialization error";
-		return false;
-	}
-	
 	// Init TCP socket protocol
 	m_SockSrv = new SocketServer();
-	m_SockSrv->set_poll_timeout_us(5000); // 200Hz
 	
-	sigset_t sigmask;
-	sigemptyset(&sigmask);
-	sigaddset(&sigmask, APPL_TIMERS_SIGNAL);
-	m_sigh = new ApplSigHandler(m_SockSrv, this);
-	if (m_SockSrv->add_signal_handler(m_sigh, &sigmask) == -1) {
-		ERROR() << "Cannot install ApplSigHandler";
+	// Timers run on the server's event loop
+	m_timers = new ApplTimerPool(4);
+	if (m_timers->initialize(m_SockSrv, this) == -1) {
+		ERROR() << "Timers initialization error";
 		return false;
 	}
 
@@ -147,8 +138,10 @@ bool APPL2::init()
 /////////////////////////////////////////////////////////////////////////////
 bool APPL2::run_thread()
 {
-	m_SockSrv->process_connections();
-	return running;
+	running = true;
+	int res = m_SockSrv->run();
+	running = false;
+	return (res == 0);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -162,3 +155,17 @@ void APPL2::on_timer()
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////
+bool APPL2::post_message(appl_msg const & msg)
+{
+	if (m_channel == 0)
+		return false;
+	return (m_channel->post(msg) == 0);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+void APPL2::on_message(appl_msg & msg)
+{
+	_VBL(2) << __func__ << " id:" << msg.id << " value:" << msg.value;
+}
+
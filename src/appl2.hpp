@@ -27,12 +27,20 @@
 //////////////////////////////////////////////////////////////////////////////
 #include <timer_pool.hpp>
 #include <sock_server.hpp>
+#include <message_channel.hpp>
 #include "applConfigFile.hpp"
 
 /////////////////////////////////////////////////////////////////////////////
-//
+/// Messaggi verso APPL2
 /////////////////////////////////////////////////////////////////////////////
-#define APPL_TIMERS_SIGNAL   ((unsigned)(SIGRTMIN+3))
+enum appl_msg_id {
+	APPL_MSG_LED_COUNTER = 1
+};
+
+struct appl_msg {
+	int id;
+	int value;
+};
 
 /////////////////////////////////////////////////////////////////////////////
 /// Classe: gestione applicativo.
@@ -60,44 +68,43 @@ public:
 	///				false= avvio errato
 	bool init();
 	
-	/// Loop di main dell'applicativo
+	/// Loop di main del thread: ritorna solo alla distruzione
 	///
 	/// \return		true= run corretto \n
 	///				false= run errato
 	bool run_thread();
+	
+	/// Accoda un messaggio per il thread di APPL2; da qualunque thread
+	///
+	/// \return		true= messaggio accodato \n
+	///				false= coda piena
+	bool post_message(appl_msg const & msg);
 
 protected:
-	class ApplSigHandler : public SocketHandler {
+	class ApplChannel : public MessageChannel<appl_msg> {
 	public:
-		ApplSigHandler(SocketServer * const server, APPL2 * const app):
-			SocketHandler(server),
+		ApplChannel(SocketServer * const server, APPL2 * const app):
+			MessageChannel<appl_msg>(server),
 			m_appl(app)
 		{}
 	
-		int on_signal(int fd, uint32_t sig, void *uptr) {
-			(void)fd;
-			if (sig == APPL_TIMERS_SIGNAL)
-				m_appl->handle_timers_signal(reinterpret_cast<aptimer_t>(uptr));
-			return 0;
+		void on_message(appl_msg & msg) {
+			m_appl->on_message(msg);
 		}
 	
 	private:
 		APPL2 *m_appl;
 	};
 	
-	void handle_timers_signal(aptimer_t elapsed_timer) {
-		ApplTimerPool::call_handler(elapsed_timer);
-	}
-	
 private:
 	void on_timer();
+	void on_message(appl_msg & msg);
 	
 //--- Variabili ---
 protected:
 	bool running;
 	
 	SocketServer        *m_SockSrv;
-	ApplSigHandler      *m_sigh;
 	
 private:
     pthread_t m_thread;
@@ -105,6 +112,8 @@ private:
     
 	ApplTimerPool       *m_timers;
 	aptimer_t 		    m_timerLed;
+	
+	ApplChannel         *m_channel;
 };
 
 #endif /* __APPL2_HPP_INCLUDED */
@@ -0,0 +1,427 @@
+/**
+******************************************************************************
+* @file    concurrent_pool_allocator.hpp
+* @brief   Thread safe pool allocator with per thread caches
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __CONCURRENT_POOLALLOC_HPP_INCLUDED
+#define __CONCURRENT_POOLALLOC_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error concurrent_pool_allocator.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <new>
+#include <memory>
+#include <utility>
+#include <logging.hpp>
+
+
+/*************************************************************************//**
+**
+** Pool allocator that any thread may use, and free objects allocated by
+** any other thread.
+**
+** Each thread works on its own magazine, a small array of free slabs, so
+** that most allocations and releases touch no shared data. An empty
+** magazine is refilled with a batch (half a magazine) of free slabs from
+** the global free list, a full one gives a batch back to it: a single
+** operation either way.
+**
+** The global free list is a lock-free (Treiber) stack of batches. Slabs
+** are linked by index rather than by address, and the head packs the
+** index of the first batch with a counter bumped on every change, so that
+** a pop racing with a pop and push of the same batch (ABA) fails its
+** compare and swap. Only 64 bit atomics are needed, on 32 bit targets as
+** well.
+**
+** Memory comes in chunks of a power of two size, aligned to that size:
+** the chunk of a slab is found by masking its address, and the chunk
+** header tells its number. Chunks are added when the free list runs dry,
+** and are only released with the pool, so that slabs always stay
+** readable by racing pops.
+**
+*****************************************************************************/
+
+template <class T>
+class ConcurrentPoolAllocator
+{
+public:
+	static const unsigned MAGAZINE_SIZE = 32;
+	static const unsigned MAX_CHUNKS = 256;
+
+	/**
+	 * @a slab_count: size of each chunk, in objects (rounded up to fill a
+	 * power of two size); the first one is allocated at once
+	 */
+	ConcurrentPoolAllocator(size_t const slab_count):
+		slab_size(sizeof(T)),
+		chunk_slabs(0),
+		chunk_size(0),
+		chunk_count(0),
+		magazines(0),
+		retired_usage(0),
+		head(0)
+	{
+		// Room for the free list links, and objects kept aligned. The links
+		// are 32 bit atomics: slabs are at least 64 bit aligned, whatever
+		// T, or a packed T would leave them misaligned (ARMv5 faults).
+		if (slab_size < 2 * sizeof(uint32_t))
+			slab_size = 2 * sizeof(uint32_t);
+		size_t const align = (__alignof__(T) > __alignof__(uint64_t)) ?
+							 __alignof__(T) : __alignof__(uint64_t);
+		slab_size = (slab_size + align - 1) & ~(align - 1);
+
+		size_t const wanted = HEADER_SIZE + (slab_count ? slab_count : 1) * slab_size;
+		chunk_size = sizeof(void *) * 2;
+		while (chunk_size < wanted)
+			chunk_size <<= 1;
+		chunk_slabs = (chunk_size - HEADER_SIZE) / slab_size;
+
+		memset(chunks, 0, sizeof(chunks));
+		pthread_mutex_init(&mutex, 0);
+		key_ready = (pthread_key_create(&key, release_magazine) == 0);
+		if (!key_ready)
+			CLOG(ERROR, "memory") << "concurrent pool @" << this << " no thread key";
+
+		pthread_mutex_lock(&mutex);
+		void * first;
+		void * last;
+		if (add_chunk(&first, &last) == 0)
+			push_batches(first, last);
+		pthread_mutex_unlock(&mutex);
+	}
+
+	virtual ~ConcurrentPoolAllocator() {
+		// Magazines of threads still alive; their objects go with the chunks
+		if (key_ready)
+			pthread_key_delete(key);
+		while (magazines != 0) {
+			magazine * const next = magazines->next;
+			free(magazines);
+			magazines = next;
+		}
+		for (unsigned i = 0; i < chunk_count; i++)
+			free(chunks[i]);
+		pthread_mutex_destroy(&mutex);
+	}
+
+	template <typename... Args>
+	T * emplace(Args &&... args) {
+		magazine * const m = get_magazine();
+		void * p;
+		if (m == 0) {
+			// No cache for this thread: borrow a batch, give the rest back
+			magazine tmp;
+			tmp.count = 0;
+			if (refill(&tmp) == 0)
+				return 0;
+			p = tmp.slabs[--tmp.count];
+			flush(&tmp, tmp.count);
+		} else {
+			if ((m->count == 0) && (refill(m) == 0))
+				return 0;
+			p = m->slabs[--m->count];
+			__atomic_store_n(&m->usage, m->usage + 1, __ATOMIC_RELAXED);
+		}
+		return new (p) T(std::forward<Args>(args)...);
+	}
+
+	T * alloc_object() {
+		return emplace();
+	}
+
+	void free_object(T * const ptr) {
+		if (ptr == 0)
+			return;
+		ptr->~T();
+		magazine * const m = get_magazine();
+		if (m == 0) {
+			link(ptr) = NIL;
+			push_batches(ptr, ptr);
+			return;
+		}
+		if (m->count == MAGAZINE_SIZE)
+			flush(m, MAGAZINE_SIZE / 2);
+		m->slabs[m->count++] = ptr;
+		__atomic_store_n(&m->usage, m->usage - 1, __ATOMIC_RELAXED);
+	}
+
+	struct deleter {
+		deleter(ConcurrentPoolAllocator * const p = 0):
+			pool(p)
+		{}
+		void operator()(T * const ptr) const {
+			pool->free_object(ptr);
+		}
+		ConcurrentPoolAllocator * pool;
+	};
+	typedef std::unique_ptr<T, deleter> unique_handle;
+
+	template <typename... Args>
+	unique_handle emplace_unique(Args &&... args) {
+		return unique_handle(emplace(std::forward<Args>(args)...), deleter(this));
+	}
+
+	uint32_t get_pool_size() const {
+		return __atomic_load_n(&chunk_count, __ATOMIC_ACQUIRE) * chunk_slabs;
+	}
+	/**
+	 * Objects in use. Threads update their own count without locking:
+	 * the result is only a snapshot.
+	 */
+	uint32_t get_pool_usage() {
+		pthread_mutex_lock(&mutex);
+		long usage = retired_usage;
+		for (magazine * m = magazines; m != 0; m = m->next)
+			usage += __atomic_load_n(&m->usage, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&mutex);
+		return (usage > 0) ? usage : 0;
+	}
+
+private:
+	struct magazine {
+		ConcurrentPoolAllocator * pool;
+		magazine * next;
+		long usage; // Allocated minus freed by this thread
+		unsigned count;
+		void * slabs[MAGAZINE_SIZE];
+	};
+
+	// Chunk header: its number, padded to keep the slabs aligned like the
+	// slab size (chunks themselves are aligned on their size)
+	static const size_t HEADER_SIZE = (sizeof(uint64_t) > __alignof__(T)) ?
+									  sizeof(uint64_t) : __alignof__(T);
+
+	static const uint32_t NIL = 0; // Links are index + 1
+	static const unsigned BATCH_SIZE = MAGAZINE_SIZE / 2;
+
+	// Free slab: next slab of its batch, and next batch for batch heads
+	uint32_t & link(void * const p) const {
+		return static_cast<uint32_t *>(p)[0];
+	}
+	uint32_t & batch_link(void * const p) const {
+		return static_cast<uint32_t *>(p)[1];
+	}
+
+	uint32_t index_of(void * const p) const {
+		uint8_t * const base = (uint8_t *)((uintptr_t)p & ~(uintptr_t)(chunk_size - 1));
+		uint32_t const chunk = *(uint32_t *)base;
+		return chunk * chunk_slabs + ((uint8_t *)p - base - HEADER_SIZE) / slab_size;
+	}
+
+	void * slab_at(uint32_t const index) const {
+		uint8_t * const base = (uint8_t *)__atomic_load_n(&chunks[index / chunk_slabs], __ATOMIC_ACQUIRE);
+		return base + HEADER_SIZE + (index % chunk_slabs) * slab_size;
+	}
+
+	/**
+	 * Global stack of batches; @a first ... @a last already chained
+	 * through their batch links
+	 */
+	void push_batches(void * const first, void * const last) {
+		uint32_t const first_link = index_of(first) + 1;
+		uint64_t old = __atomic_load_n(&head, __ATOMIC_RELAXED);
+		uint64_t top;
+		do {
+			__atomic_store_n(&batch_link(last), (uint32_t)old, __ATOMIC_RELAXED);
+			top = (((old >> 32) + 1) << 32) | first_link;
+		} while (!__atomic_compare_exchange_n(&head, &old, top, true,
+											  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+
+	/**
+	 * @return head of a batch, its slabs chained through link()
+	 */
+	void * pop_batch() {
+		uint64_t old = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+		for (;;) {
+			uint32_t const first = (uint32_t)old;
+			if (first == NIL)
+				return 0;
+			void * const p = slab_at(first - 1);
+			// May be stale if another thread took p meanwhile: the tag then
+			// makes the exchange fail
+			uint32_t const next = __atomic_load_n(&batch_link(p), __ATOMIC_RELAXED);
+			uint64_t const top = (((old >> 32) + 1) << 32) | next;
+			if (__atomic_compare_exchange_n(&head, &old, top, true,
+											__ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+				return p;
+		}
+	}
+
+	void take_batch(magazine * const m, void * p) {
+		while (p != 0) {
+			m->slabs[m->count++] = p;
+			uint32_t const next = link(p);
+			p = (next != NIL) ? slab_at(next - 1) : 0;
+		}
+	}
+
+	/**
+	 * Give the @a count oldest slabs of @a m back, a batch at a time
+	 */
+	void flush(magazine * const m, unsigned const count) {
+		for (unsigned done = 0; done < count; ) {
+			unsigned const n = (count - done < BATCH_SIZE) ? count - done : BATCH_SIZE;
+			void ** const batch = m->slabs + done;
+			for (unsigned i = 0; i + 1 < n; i++)
+				link(batch[i]) = index_of(batch[i + 1]) + 1;
+			link(batch[n - 1]) = NIL;
+			push_batches(batch[0], batch[0]);
+			done += n;
+		}
+		m->count -= count;
+		memmove(m->slabs, m->slabs + count, m->count * sizeof(void *));
+	}
+
+	/**
+	 * Fill an empty magazine with a batch, growing the pool if needed
+	 * @return number of slabs obtained
+	 */
+	unsigned refill(magazine * const m) {
+		void * p = pop_batch();
+		if (p != 0) {
+			take_batch(m, p);
+			return m->count;
+		}
+
+		pthread_mutex_lock(&mutex);
+		// Someone else may have grown the pool while we were waiting
+		p = pop_batch();
+		if (p != 0)
+			take_batch(m, p);
+		else {
+			void * first;
+			void * last;
+			if (add_chunk(&first, &last) == 0) {
+				// Keep the first batch, publish the others
+				uint32_t const next = batch_link(first);
+				take_batch(m, first);
+				if (next != NIL)
+					push_batches(slab_at(next - 1), last);
+			}
+		}
+		pthread_mutex_unlock(&mutex);
+		return m->count;
+	}
+
+	/**
+	 * New chunk, cut in batches of slabs in address order. Called with
+	 * the mutex held.
+	 * @a first, @a last: heads of the first and last batches
+	 */
+	int add_chunk(void ** const first, void ** const last) {
+		if (chunk_count == MAX_CHUNKS) {
+			CLOG(ERROR, "memory") << "concurrent pool @" << this << " full";
+			return -1;
+		}
+		void * base;
+		if (posix_memalign(&base, chunk_size, chunk_size) != 0) {
+			CLOG(ERROR, "memory") << "concurrent pool @" << this << " cannot allocate " << chunk_size;
+			return -1;
+		}
+		*(uint32_t *)base = chunk_count;
+		uint32_t const first_index = chunk_count * chunk_slabs;
+		uint8_t * const slabs = (uint8_t *)base + HEADER_SIZE;
+		for (uint32_t i = 0; i < chunk_slabs; i++) {
+			void * const p = slabs + i * slab_size;
+			bool const batch_end = ((i + 1) % BATCH_SIZE == 0) || (i + 1 == chunk_slabs);
+			link(p) = batch_end ? NIL : first_index + i + 2;
+			if (i % BATCH_SIZE == 0)
+				batch_link(p) = (i + BATCH_SIZE < chunk_slabs) ? first_index + i + BATCH_SIZE + 1 : NIL;
+		}
+		*first = slabs;
+		*last = slabs + ((chunk_slabs - 1) / BATCH_SIZE) * BATCH_SIZE * slab_size;
+		// Published before any of its slabs can be reached
+		__atomic_store_n(&chunks[chunk_count], base, __ATOMIC_RELEASE);
+		__atomic_store_n(&chunk_count, chunk_count + 1, __ATOMIC_RELEASE);
+		CVLOG(2, "memory") << "concurrent pool @" << this << " chunk " << chunk_count << " @" << base;
+		return 0;
+	}
+
+	magazine * get_magazine() {
+		if (!key_ready)
+			return 0;
+		magazine * m = static_cast<magazine *>(pthread_getspecific(key));
+		if (m != 0)
+			return m;
+		m = static_cast<magazine *>(calloc(1, sizeof(magazine)));
+		if (m == 0)
+			return 0;
+		m->pool = this;
+		pthread_setspecific(key, m);
+		pthread_mutex_lock(&mutex);
+		m->next = magazines;
+		magazines = m;
+		pthread_mutex_unlock(&mutex);
+		return m;
+	}
+
+	/**
+	 * Thread exit: its cached slabs go back to the global list
+	 */
+	static void release_magazine(void * const arg) {
+		magazine * const m = static_cast<magazine *>(arg);
+		ConcurrentPoolAllocator * const pool = m->pool;
+		pool->flush(m, m->count);
+		pthread_mutex_lock(&pool->mutex);
+		pool->retired_usage += m->usage;
+		magazine ** pp = &pool->magazines;
+		while (*pp != m)
+			pp = &(*pp)->next;
+		*pp = m->next;
+		pthread_mutex_unlock(&pool->mutex);
+		free(m);
+	}
+
+	ConcurrentPoolAllocator(ConcurrentPoolAllocator const &);
+	ConcurrentPoolAllocator & operator=(ConcurrentPoolAllocator const &);
+
+private:
+	size_t slab_size;
+	uint32_t chunk_slabs;
+	size_t chunk_size;
+	uint32_t chunk_count;
+	void * chunks[MAX_CHUNKS];
+
+	pthread_key_t key;
+	bool key_ready;
+	pthread_mutex_t mutex; // Growth and magazine list
+	magazine * magazines;
+	long retired_usage;
+
+	// Tag (high half) and link to the first free slab (low half), on its
+	// own cache line
+	uint8_t pad0[64];
+	uint64_t head __attribute__((aligned(8)));
+	uint8_t pad1[64 - sizeof(uint64_t)];
+};
+
+/****************************************************************************/
+
+#endif /* __CONCURRENT_POOLALLOC_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,147 @@
+/**
+******************************************************************************
+* @file    config_writer.cpp
+*****************************************************************************/
+
+#include <signal.h>
+#include "config_writer.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "conf"
+
+
+/*************************************************************************//**
+**
+*/
+ConfigWriter::ConfigWriter():
+	thread_created(false),
+	running(false)
+{
+	pthread_mutex_init(&mutex, 0);
+	pthread_cond_init(&queued_cond, 0);
+	pthread_cond_init(&done_cond, 0);
+}
+
+
+/*************************************************************************//**
+**
+*/
+ConfigWriter::~ConfigWriter()
+{
+	stop();
+	pthread_cond_destroy(&done_cond);
+	pthread_cond_destroy(&queued_cond);
+	pthread_mutex_destroy(&mutex);
+}
+
+
+/*************************************************************************//**
+**
+*/
+int ConfigWriter::start()
+{
+	pthread_mutex_lock(&mutex);
+	if (running) {
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	running = true;
+	pthread_mutex_unlock(&mutex);
+
+	if (pthread_create(&thread, NULL, writer_thread, this) != 0) {
+		_ERROR() << "cannot create config writer thread";
+		running = false;
+		return -1;
+	}
+	thread_created = true;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Requests queued are written first
+*/
+void ConfigWriter::stop()
+{
+	pthread_mutex_lock(&mutex);
+	running = false;
+	pthread_cond_signal(&queued_cond);
+	pthread_mutex_unlock(&mutex);
+
+	if (thread_created) {
+		pthread_join(thread, 0);
+		thread_created = false;
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+int ConfigWriter::submit(ConfigFile::write_request * const req)
+{
+	pthread_mutex_lock(&mutex);
+	if (!running) {
+		pthread_mutex_unlock(&mutex);
+		return -1;
+	}
+	queue.push_back(req);
+	pthread_cond_signal(&queued_cond);
+	pthread_mutex_unlock(&mutex);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void ConfigWriter::wait(ConfigFile::write_request * const req)
+{
+	pthread_mutex_lock(&mutex);
+	while (!req->done)
+		pthread_cond_wait(&done_cond, &mutex);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void * ConfigWriter::writer_thread(void * const arg)
+{
+	// Signals are handled by the main thread only
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, NULL);
+
+	_VBL(1) << "config writer thread started ID:" << HEX(pthread_self(), sizeof(pthread_t)*2);
+	static_cast<ConfigWriter *>(arg)->process();
+	return 0;
+}
+
+
+/*************************************************************************//**
+** The snapshot is dropped here, before the request is marked done: the
+** file owns its dictionary again by the time it sees the outcome
+*/
+void ConfigWriter::process()
+{
+	pthread_mutex_lock(&mutex);
+	for (;;) {
+		while (queue.empty() && running)
+			pthread_cond_wait(&queued_cond, &mutex);
+		if (queue.empty())
+			break;
+		ConfigFile::write_request * const req = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&mutex);
+
+		req->result = ConfigFile::write_dict(*req->snapshot, req->path.c_str(), req->section.c_str());
+		req->snapshot.reset();
+
+		pthread_mutex_lock(&mutex);
+		__atomic_store_n(&req->done, true, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&done_cond);
+	}
+	pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,97 @@
+/**
+******************************************************************************
+* @file    config_writer.hpp
+* @brief   Background thread writing ConfigFile snapshots
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __CONFIG_WRITER_HPP_INCLUDED
+#define __CONFIG_WRITER_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error config_writer.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <deque>
+#include "configfile.hpp"
+
+using namespace std;
+
+
+/*************************************************************************//**
+**
+** Thread doing the file I/O of the ConfigFile instances given to it (see
+** ConfigFile::set_writer()), so that a slow storage does not stall the
+** event loop flushing them. Requests are written in order, one at a time.
+**
+** The writer only touches the snapshot of the request: the file collects
+** the outcome itself, on its own thread. stop() (and the destructor) write
+** every request already queued before joining the thread.
+**
+*****************************************************************************/
+
+class ConfigWriter
+{
+public:
+	ConfigWriter();
+	virtual ~ConfigWriter();
+
+	int start();
+	void stop();
+
+	bool is_running() const {
+		return running;
+	}
+
+private:
+	friend class ConfigFile;
+
+	/**
+	 * @return 0 on success, -1 if the writer is not running
+	 */
+	int submit(ConfigFile::write_request * req);
+	/**
+	 * Block until @a req, queued, has been written
+	 */
+	void wait(ConfigFile::write_request * req);
+
+	static void * writer_thread(void * arg);
+	void process();
+
+	ConfigWriter(ConfigWriter const &);
+	ConfigWriter & operator=(ConfigWriter const &);
+
+private:
+	pthread_t thread;
+	bool thread_created;
+	bool running;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued_cond;
+	pthread_cond_t done_cond;
+	deque<ConfigFile::write_request *> queue;
+};
+
+
+/****************************************************************************/
+
+#endif /* __CONFIG_WRITER_HPP_INCLUDED */
+/* EOF */
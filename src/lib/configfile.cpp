@@ -14,7 +14,14 @@
 #include <string.h>
 #include <float.h>
 #include <limits.h>
+#include <time.h>
 #include "configfile.hpp"
+#include "config_writer.hpp"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
@@ -57,6 +64,9 @@ using namespace std;
 #ifndef _VBL
 #define _VBL(l) std::cerr << "[filecfg " << l << "] "
 #endif
+#ifndef _ERROR
+#define _ERROR() std::cerr << "[filecfg error] "
+#endif
 #ifndef ENDL
 #define ENDL <<std::endl
 #endif
@@ -77,9 +87,20 @@ using namespace std;
 **
 */
 ConfigFile::ConfigFile():
+	dict(make_shared<keyval_dict_t>()),
 	active_section(0),
 	modified(false),
-	update_on_destruction(false)
+	update_on_destruction(false),
+	flush_interval(0),
+	modified_since(0),
+	journal_fd(-1),
+	journal_size(0),
+	journal_limit(0),
+	unsynced_since(0),
+	generation(0),
+	writer(0),
+	request(0),
+	write_in_flight(false)
 {
 }
 
@@ -88,9 +109,20 @@ ConfigFile::ConfigFile():
 **
 */
 ConfigFile::ConfigFile(const char * filepath):
+	dict(make_shared<keyval_dict_t>()),
 	active_section(0),
 	modified(false),
-	update_on_destruction(true)
+	update_on_destruction(true),
+	flush_interval(0),
+	modified_since(0),
+	journal_fd(-1),
+	journal_size(0),
+	journal_limit(0),
+	unsynced_since(0),
+	generation(0),
+	writer(0),
+	request(0),
+	write_in_flight(false)
 {
 	open(filepath);
 }
@@ -100,9 +132,20 @@ ConfigFile::ConfigFile(const char * filepath):
 **
 */
 ConfigFile::ConfigFile(const char * filepath, const char * section):
+	dict(make_shared<keyval_dict_t>()),
 	active_section(0),
 	modified(false),
-	update_on_destruction(true)
+	update_on_destruction(true),
+	flush_interval(0),
+	modified_since(0),
+	journal_fd(-1),
+	journal_size(0),
+	journal_limit(0),
+	unsynced_since(0),
+	generation(0),
+	writer(0),
+	request(0),
+	write_in_flight(false)
 {
 	open(filepath, section);
 }
@@ -113,10 +156,16 @@ ConfigFile::ConfigFile(const char * filepath, const char * section):
 */
 ConfigFile::~ConfigFile()
 {
-	if (update_on_destruction) {
-		if (modified)
-			write();
-	}
+	if (update_on_destruction)
+		flush(true);
+	finish_write(true);
+	delete request;
+	for (size_t i = 0; i < bindings.size(); i++)
+		delete bindings[i];
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (journal_fd >= 0)
+		::close(journal_fd);
+#endif
 }
 
 
@@ -159,6 +208,35 @@ static char* find_char_or_comment(const char* s, char c)
     return (char*)s;
 }
 
+/* Milliseconds from an arbitrary origin, not affected by clock changes. */
+static uint64_t monotonic_ms()
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+/* Make a rename in the directory of filepath durable. */
+static void sync_parent_dir(const char* filepath)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    const char* sep = strrchr(filepath, '/');
+    const string dir = (sep == NULL) ? string(".") :
+                       (sep == filepath) ? string("/") : string(filepath, sep - filepath);
+    int fd = ::open(dir.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    fsync(fd);
+    ::close(fd);
+#else
+    (void)filepath;
+#endif
+}
+
 /* Version of strncpy that ensures dest (size bytes) is null-terminated. */
 static char* strncpy0(char* dest, const char* src, size_t size)
 {
@@ -280,34 +358,98 @@ int ConfigFile::open(const char * filepath, const char * section)
 	_VBL(1) << "Opening " << std::setw(24) << std::setfill(' ') << filepath ENDL;
 
 	file_path = filepath;
+	journal_path = file_path + ".journal";
 	active_section = (section == 0) ? "": section;
 
 	file = fopen(filepath, "r");
-    if (!file)
-        return -1;
-    
-	error = ini_parse_file(file);
+	if (file) {
+		error = ini_parse_file(file);
+		fclose(file);
+	} else
+		error = -1;
 	modified = false;
-    
-	fclose(file);
+
+	// Changes journaled but never compacted into the file: the file has
+	// to be rewritten, whatever the mode
+	if (replay_journal() > 0)
+		set_modified();
+
+	for (size_t i = 0; i < bindings.size(); i++)
+		bindings[i]->refresh(*this);
 
 #if DUMP_KEYS_ON_LOAD
 	// Dump (key,value) pairs to console (or log)
  	keyval_dict_t::const_iterator ii;
- 	for (ii = dict.begin(); ii != dict.end(); ++ii)
-		_VBL(2) << "\t" << ii->first << " = \"" << ii->second << "\"" ENDL;
+ 	for (ii = dict->begin(); ii != dict->end(); ++ii)
+		_VBL(2) << "\t" << ii->key << " = \"" << ii->value << "\"" ENDL;
 #endif
 	
 	return error;
 }
 
 
+/*************************************************************************//**
+** Records are applied in order, the last one of a key wins.
+** @return number of records applied
+*/
+int ConfigFile::replay_journal()
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	FILE * const file = fopen(journal_path.c_str(), "r");
+	if (!file)
+		return 0;
+
+	char * line = NULL;
+	size_t line_size = 0;
+	ssize_t len;
+	int records = 0;
+	while ((len = getline(&line, &line_size, file)) > 0) {
+		// Only the last record may be torn (crash while appending)
+		if (line[len - 1] != '\n')
+			break;
+		line[len - 1] = '\0';
+		char * const sep = strchr(line, '=');
+		if (sep == NULL)
+			continue;
+		*sep = '\0';
+		const char * const key = rstrip(lskip(line));
+		if (*key == '\0')
+			continue;
+		own_dict();
+		dict->insert(key, lskip(sep + 1), true);
+		records++;
+	}
+	free(line);
+	fclose(file);
+
+	if (records)
+		_VBL(1) << "Replayed " << records << " records from \"" << journal_path << "\"" ENDL;
+	return records;
+#else
+	return 0;
+#endif
+}
+
+
+/*************************************************************************//**
+** From a fresh dictionary: open() alone adds the keys of the file to those
+** already known, without changing their values
+*/
+int ConfigFile::reload()
+{
+	dict = make_shared<keyval_dict_t>();
+	const string path = file_path;
+	return open(path.c_str(), active_section);
+}
+
+
 bool ConfigFile::handle_key(const char* section, const char* key, const char* value)
 {
 	if (active_section && strcmp(section, active_section))
 		return true; // Ignored section
 
-	dict.insert(std::pair<string,string>(key, value));
+	own_dict();
+	dict->insert(key, value, false);
 	return false;
 }
 
@@ -328,17 +470,126 @@ int ConfigFile::write(const char * filepath)
 	return rewrite(filepath, active_section);
 }
 
-int ConfigFile::rewrite(const char * filepath, const char * section)
+/*************************************************************************//**
+**
+*/
+int ConfigFile::flush(bool force)
+{
+	finish_write(false);
+	if (!modified)
+		return 0;
+	if (journal_fd >= 0) {
+		// The changes are on the journal already
+		if (!force && (journal_size < journal_limit))
+			return sync_journal(false);
+	} else
+	if (!force && (monotonic_ms() - modified_since < flush_interval))
+		return 0;
+
+	if (force || (writer == 0))
+		return write();
+	// One background write at a time: the changes wait for the next flush
+	if (write_in_flight)
+		return 0;
+	return start_write();
+}
+
+
+/*************************************************************************//**
+** The snapshot costs a reference: put() copies the dictionary only if it
+** changes it while the snapshot is being written
+*/
+int ConfigFile::start_write()
+{
+	if (request == 0)
+		request = new write_request;
+	request->snapshot = dict;
+	request->path = file_path;
+	request->section = (active_section != 0) ? active_section : "";
+	request->generation = generation;
+	request->journal_size = journal_size;
+	request->result = -1;
+	request->done = false;
+	if (writer->submit(request) != 0) {
+		request->snapshot.reset();
+		return write();
+	}
+	write_in_flight = true;
+	// Changes made from now on are not in the snapshot
+	modified_since = monotonic_ms();
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Collect the background write, if done (or once done, with @a wait).
+** What changed since its snapshot stays to be written.
+*/
+void ConfigFile::finish_write(bool wait)
+{
+	if (!write_in_flight)
+		return;
+	if (wait)
+		writer->wait(request);
+	else
+	if (!__atomic_load_n(&request->done, __ATOMIC_ACQUIRE))
+		return;
+	write_in_flight = false;
+
+	if (request->result == 0) {
+		if (request->generation == generation)
+			modified = false;
+		// The file now holds everything the journal had, as in rewrite()
+		if (!journal_path.empty() && (request->path == file_path)) {
+#if !defined(_WIN32) && !defined(_WIN64)
+			if (journal_fd >= 0) {
+				if ((journal_size == request->journal_size) &&
+					(ftruncate(journal_fd, 0) == 0)) {
+					journal_size = 0;
+					unsynced_since = 0;
+				}
+			} else
+#endif
+				remove(journal_path.c_str());
+		}
+	}
+	on_written(request->result);
+}
+
+
+/*************************************************************************//**
+** Called by put() and the loaders before changing the dictionary
+*/
+void ConfigFile::own_dict()
+{
+	if (dict.unique()) {
+		// The writer thread may have just dropped the snapshot: see all
+		// it did with the dictionary before changing it
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		return;
+	}
+	dict = make_shared<keyval_dict_t>(*dict);
+}
+
+/*************************************************************************//**
+** The dictionary goes to a temporary file, synced then renamed over the
+** target: a crash or a power cut leaves either the old or the new file,
+** never a truncated one. Runs on the writer thread as well: the dictionary
+** only, no member.
+*/
+int ConfigFile::write_dict(const keyval_dict_t & d, const char * filepath, const char * section)
 {
     FILE* file;
     int error = 0;
 
 	_VBL(1) << "Rewriting file \"" << filepath << "\" section [" << section << "]" ENDL;
 
-	// Try to open the file for update
-	file = fopen(filepath, "w+");
-	if (!file)
+	const string tmp_path = string(filepath) + ".tmp";
+	file = fopen(tmp_path.c_str(), "w");
+	if (!file) {
+		_ERROR() << "Cannot create \"" << tmp_path << "\"" ENDL;
 		return -1;
+	}
 
 	// Write active section name, if available
 	if ((section != NULL) && (*section != 0))
@@ -346,22 +597,155 @@ int ConfigFile::rewrite(const char * filepath, const char * section)
 
 	// Write (key,value) pairs
 	keyval_dict_t::const_iterator ii;
-	for (ii = dict.begin(); ii != dict.end(); ++ii) {
-		fprintf(file, "%s = %s\n", ii->first.c_str(), ii->second.c_str());
+	for (ii = d.begin(); ii != d.end(); ++ii) {
+		fprintf(file, "%s = %s\n", ii->key.c_str(), ii->value.c_str());
 #if DUMP_KEYS_ON_SAVE
-		_VBL(2) << "    " << ii->first << " = \"" << ii->second << "\"" ENDL;
+		_VBL(2) << "    " << ii->key << " = \"" << ii->value << "\"" ENDL;
 #endif
 	}
 	
-	fclose(file);
-	
+	if ((fflush(file) != 0) || ferror(file))
+		error = -1;
+#if !defined(_WIN32) && !defined(_WIN64)
+	else
+	if (fsync(fileno(file)) != 0)
+		error = -1;
+#endif
+	if (fclose(file) != 0)
+		error = -1;
+
+#if defined(_WIN32) || defined(_WIN64)
 	if (error == 0)
-		modified = false;
-	
+		remove(filepath);
+#endif
+	if ((error == 0) && (rename(tmp_path.c_str(), filepath) != 0))
+		error = -1;
+
+	if (error != 0) {
+		_ERROR() << "Cannot write \"" << filepath << "\"" ENDL;
+		remove(tmp_path.c_str());
+		return error;
+	}
+	sync_parent_dir(filepath);
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int ConfigFile::rewrite(const char * filepath, const char * section)
+{
+	// Never two writers on the same temporary file
+	finish_write(true);
+
+	int error = write_dict(*dict, filepath, section);
+	if (error != 0)
+		return error;
+
+	// The file now holds everything the journal had
+	if (!journal_path.empty() && (file_path == filepath)) {
+#if !defined(_WIN32) && !defined(_WIN64)
+		if (journal_fd >= 0) {
+			if (ftruncate(journal_fd, 0) == 0) {
+				journal_size = 0;
+				unsynced_since = 0;
+			}
+		} else
+#endif
+			remove(journal_path.c_str());
+	}
+
+	modified = false;
 	return error;
 }
 
 
+/*************************************************************************//**
+**
+*/
+int ConfigFile::enable_journal(size_t compact_size)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (journal_path.empty())
+		return -1;
+	journal_limit = compact_size;
+	if (journal_fd >= 0)
+		return 0;
+
+	journal_fd = ::open(journal_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+	if (journal_fd < 0) {
+		_ERROR() << "Cannot open \"" << journal_path << "\"" ENDL;
+		return -1;
+	}
+	journal_size = 0;
+	// Compact what open() replayed, so that new records don't follow a
+	// torn one
+	if ((lseek(journal_fd, 0, SEEK_END) > 0) && (write() != 0)) {
+		::close(journal_fd);
+		journal_fd = -1;
+		return -1;
+	}
+	return 0;
+#else
+	(void)compact_size;
+	return -1;
+#endif
+}
+
+
+/*************************************************************************//**
+** One write() per record: no stdio buffer to lose, no fsync either (see
+** sync_journal())
+*/
+void ConfigFile::append_journal(const char * key, const char * value)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	string record(key);
+	record += " = ";
+	record += value;
+	record += '\n';
+	const ssize_t n = ::write(journal_fd, record.data(), record.size());
+	if (n != (ssize_t)record.size()) {
+		_ERROR() << "Cannot append to \"" << journal_path << "\"" ENDL;
+		// Drop a partial record, and have the next flush() rewrite the file
+		if (n > 0)
+			ftruncate(journal_fd, journal_size);
+		journal_size = journal_limit;
+		return;
+	}
+	journal_size += n;
+	if (unsynced_since == 0)
+		unsynced_since = monotonic_ms() | 1;
+#else
+	(void)key;
+	(void)value;
+#endif
+}
+
+
+/*************************************************************************//**
+** Records reach the media at most once per flush interval
+*/
+int ConfigFile::sync_journal(bool force)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (unsynced_since == 0)
+		return 0;
+	if (!force && (monotonic_ms() - unsynced_since < flush_interval))
+		return 0;
+	if (fdatasync(journal_fd) != 0) {
+		_ERROR() << "Cannot sync \"" << journal_path << "\"" ENDL;
+		return -1;
+	}
+	unsynced_since = 0;
+#else
+	(void)force;
+#endif
+	return 0;
+}
+
+
 /*************************************************************************//**
 **
 ** Load methods
@@ -373,15 +757,15 @@ int ConfigFile::rewrite(const char * filepath, const char * section)
 */
 int ConfigFile::get(const char * key, char * dest, const char * default_value, size_t max_size)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
+	const keyval_dict_t::entry * elem = dict->find(key);
 	
-	if (elem == dict.end()) {
+	if (elem == 0) {
 		if (default_value)
 			strncpy0(dest, default_value, max_size);
 		return -1;
 	}
 	
-	strncpy0(dest, elem->second.c_str(), max_size);
+	strncpy0(dest, elem->value.c_str(), max_size);
 	return 0;
 }
 
@@ -390,22 +774,26 @@ int ConfigFile::get(const char * key, char * dest, const char * default_value, s
 */
 int ConfigFile::get(const char * key, int64_t &dest, int64_t default_value)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
-	char * eptr;
+	const keyval_dict_t::entry * const elem = dict->find(key);
 	
-	if (elem == dict.end()) {
+	if (elem == 0) {
 		dest = default_value;
 		return -1;
 	}
 
-	const char * const s = elem->second.c_str();
-	int64_t tval = strtoll(s, &eptr, 10);
-	if (*eptr != 0) {
+	// Parsed on first use only
+	if (!(elem->cached & keyval_dict_t::CACHED_INT64)) {
+		char * eptr;
+		elem->i64 = strtoll(elem->value.c_str(), &eptr, 10);
+		elem->cached |= keyval_dict_t::CACHED_INT64 |
+						((*eptr == 0) ? keyval_dict_t::VALID_INT64 : 0);
+	}
+	if (!(elem->cached & keyval_dict_t::VALID_INT64)) {
 		dest = default_value;
 		return -1;
 	}
 	
-	dest = tval;
+	dest = elem->i64;
 	return 0;
 }
 
@@ -482,29 +870,34 @@ int ConfigFile::get(const char * key, int8_t  &dest, int8_t  default_value)
 */
 int ConfigFile::get(const char * key, uint64_t &dest, uint64_t default_value)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
-	char * eptr;
-	int base = 10;
+	const keyval_dict_t::entry * const elem = dict->find(key);
 	
-	if (elem == dict.end()) {
+	if (elem == 0) {
 		dest = default_value;
 		return -1;
 	}
 
-	const char * s = elem->second.c_str();
-	// Skip leading spaces
-	while (*s == ' ') s++;
-	 // Check for hexadecimal value
-	if ((s[0] == '0') && ((s[1] == 'x') || (s[1] == 'X')))
-		base = 16;
-	// Convert value
-	dest = strtoull(s, &eptr, base);
-	// If string contains invalid characters, set default value
-	// and return with an error code
-	if ((*eptr != 0) && (*eptr != ' ')) {
+	// Parsed on first use only
+	if (!(elem->cached & keyval_dict_t::CACHED_UINT64)) {
+		char * eptr;
+		int base = 10;
+		const char * s = elem->value.c_str();
+		// Skip leading spaces
+		while (*s == ' ') s++;
+		 // Check for hexadecimal value
+		if ((s[0] == '0') && ((s[1] == 'x') || (s[1] == 'X')))
+			base = 16;
+		// Convert value
+		elem->u64 = strtoull(s, &eptr, base);
+		// Invalid characters: the default value is used
+		elem->cached |= keyval_dict_t::CACHED_UINT64 |
+						(((*eptr == 0) || (*eptr == ' ')) ? keyval_dict_t::VALID_UINT64 : 0);
+	}
+	if (!(elem->cached & keyval_dict_t::VALID_UINT64)) {
 		dest = default_value;
 		return -1;
 	}
+	dest = elem->u64;
 	return 0;
 }
 
@@ -587,22 +980,26 @@ int ConfigFile::get(const char * key, bool &dest, bool default_value)
 */
 int ConfigFile::get(const char * key, double &dest, double default_value)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
-	char * eptr;
+	const keyval_dict_t::entry * const elem = dict->find(key);
 	
-	if (elem == dict.end()) {
+	if (elem == 0) {
 		dest = default_value;
 		return -1;
 	}
 
-	const char * const s = elem->second.c_str();
-	double tval = strtod(s, &eptr);
-	if (*eptr != 0) {
+	// Parsed on first use only
+	if (!(elem->cached & keyval_dict_t::CACHED_DOUBLE)) {
+		char * eptr;
+		elem->f64 = strtod(elem->value.c_str(), &eptr);
+		elem->cached |= keyval_dict_t::CACHED_DOUBLE |
+						((*eptr == 0) ? keyval_dict_t::VALID_DOUBLE : 0);
+	}
+	if (!(elem->cached & keyval_dict_t::VALID_DOUBLE)) {
 		dest = default_value;
 		return -1;
 	}
 	
-	dest = tval;
+	dest = elem->f64;
 	return 0;
 }
 
@@ -634,14 +1031,14 @@ int ConfigFile::get(const char * key, float  &dest, float  default_value)
 */
 int ConfigFile::get(const char * key, struct in_addr *dest, const struct in_addr *default_value)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
+	const keyval_dict_t::entry * elem = dict->find(key);
 	
-	if (elem == dict.end()) {
+	if (elem == 0) {
 		*dest = *default_value;
 		return -1;
 	}
 
-	const char * const s = elem->second.c_str();
+	const char * const s = elem->value.c_str();
 	struct in_addr tmp;
 
 	if (!inet_pton(AF_INET, s, &tmp)) {
@@ -668,13 +1065,13 @@ int ConfigFile::get(const char * key, struct in_addr *dest, const char * const d
 */
 int ConfigFile::get_raw(const char * key, void * dest, size_t expected_size)
 {
-	keyval_dict_t::iterator elem = dict.find(key);
+	const keyval_dict_t::entry * elem = dict->find(key);
 	
-	if (elem == dict.end())
+	if (elem == 0)
 		return -1;
 	
 	unsigned dec_len = bin_decode(static_cast<uint8_t *>(dest),
-									elem->second.c_str(), expected_size);
+									elem->value.c_str(), expected_size);
 	if (dec_len != expected_size)
 		return -1;
 	else
@@ -702,28 +1099,62 @@ int ConfigFile::put(const char * key, const char * value)
 #else
 #define _DUMP_KEYVAL(k, v, m)
 #endif
-	keyval_dict_t::iterator elem = dict.find(key);
-	if (elem == dict.end()) {
-		modified = true;
-		dict.insert(std::pair<string,string>(key, value));
+	keyval_dict_t::entry * elem = dict->find(key);
+	if (elem == 0) {
+		set_modified();
+		own_dict();
+		dict->insert(key, value, false);
+		if (journal_fd >= 0)
+			append_journal(key, value);
+		update_bindings(key);
 		_DUMP_KEYVAL(key, value, "created");
 		return 0;
 	}
 
-	const char * orig = elem->second.c_str();
+	const char * orig = elem->value.c_str();
 	if (strcmp(orig, value) != 0) {
-		modified = true;
-		elem->second = value;
-		_DUMP_KEYVAL(elem->first, elem->second, "modified");
+		set_modified();
+		keyval_dict_t const * const shared = dict.get();
+		own_dict();
+		if (dict.get() != shared)
+			elem = dict->find(key);
+		dict->set_value(elem, value);
+		if (journal_fd >= 0)
+			append_journal(key, value);
+		update_bindings(key);
+		_DUMP_KEYVAL(elem->key, elem->value, "modified");
 		return 0;
 	} else {
-		_DUMP_KEYVAL(elem->first, elem->second, "unchanged");
+		_DUMP_KEYVAL(elem->key, elem->value, "unchanged");
 	}
 
 	return 1;
 }
 
 
+/*************************************************************************//**
+** The flush interval runs from the first change not yet written
+*/
+void ConfigFile::set_modified()
+{
+	if (!modified)
+		modified_since = monotonic_ms();
+	modified = true;
+	generation++;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void ConfigFile::update_bindings(const char * key)
+{
+	for (size_t i = 0; i < bindings.size(); i++)
+		if (bindings[i]->key == key)
+			bindings[i]->refresh(*this);
+}
+
+
 /*************************************************************************//**
 **
 */
@@ -34,9 +34,11 @@
 #include <stdint.h>
 #include <stdio.h> 
 #include <string>
-#include <map>
+#include <memory>
+#include <vector>
 
 #include <asciibin.hpp>
+#include "flat_dict.hpp"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <Ws2tcpip.h>
@@ -52,11 +54,69 @@
 
 using namespace std;
 
+class ConfigWriter;
+
 class ConfigFile
 {
+	friend class ConfigWriter;
+
 //  TYPES  ///////////////////////////////////////////////////////////////////
 protected:
-	typedef map<string, string> keyval_dict_t;
+	// Lookups from the const char * keys allocate nothing, numeric values
+	// are parsed once
+	typedef FlatDict keyval_dict_t;
+
+	/**
+	 * Key bound with bind(), its value kept up to date by put() and open()
+	 */
+	class binding {
+	public:
+		binding(const char * k):
+			key(k)
+		{}
+		virtual ~binding() {}
+		virtual void refresh(ConfigFile & cf) = 0;
+		const string key;
+	};
+
+	template <class T>
+	class typed_binding : public binding {
+	public:
+		typed_binding(const char * k, T const def):
+			binding(k),
+			value(def),
+			default_value(def)
+		{}
+		void refresh(ConfigFile & cf) {
+			cf.get(key.c_str(), value, default_value);
+		}
+		T value;
+		const T default_value;
+	};
+
+public:
+	/**
+	 * Pre-resolved key, see bind()
+	 */
+	template <class T>
+	class handle {
+	public:
+		handle():
+			value(0)
+		{}
+		T get() const {
+			return *value;
+		}
+		operator T() const {
+			return *value;
+		}
+	private:
+		friend class ConfigFile;
+		explicit handle(const T * v):
+			value(v)
+		{}
+		const T * value;
+	};
 
 //  METHODS  /////////////////////////////////////////////////////////////////
 public:
@@ -66,6 +126,10 @@ public:
 	virtual ~ConfigFile();
 	
 	int open(const char * filepath, const char * section = 0);
+	/**
+	 * Read the file again, dropping the changes not written
+	 */
+	int reload();
 	
 	int write();
 	int write(const char * filepath);
@@ -78,6 +142,46 @@ public:
 		return modified;
 	}
 
+	/**
+	 * Write-behind: changes are written by flush() once the oldest of them
+	 * is @a interval_ms old, so that a burst of put() costs one write.
+	 * 0 (default): flush() writes whatever is changed.
+	 */
+	void set_flush_interval(uint32_t interval_ms) {
+		flush_interval = interval_ms;
+	}
+	/**
+	 * Meant to be called periodically. @a force: don't wait for the
+	 * interval (shutdown)
+	 * @return 0 if nothing was due or the file was written, -1 on error
+	 */
+	int flush(bool force = false);
+
+	/**
+	 * Journal mode: put() appends a "key = value" record to
+	 * "<file>.journal" instead of waiting for the next rewrite of the whole
+	 * file. flush() then only syncs the journal, once per flush interval,
+	 * and folds it into the file (compaction) once it has grown beyond
+	 * @a compact_size bytes, or when forced. open() replays any journal
+	 * left over, in journal mode or not.
+	 * @return 0 on success, -1 if the journal cannot be opened
+	 */
+	int enable_journal(size_t compact_size = JOURNAL_COMPACT_SIZE);
+
+	static const size_t JOURNAL_COMPACT_SIZE = 16384;
+
+	/**
+	 * Have flush() hand the file I/O to @a writer: it then writes a
+	 * snapshot of the dictionary on the writer thread, and reports the
+	 * outcome through on_written() on a later flush(). Forced flushes,
+	 * write() and the destructor still write synchronously, after the
+	 * background write in progress, if any. 0: synchronous flushes.
+	 * The writer must outlive the file.
+	 */
+	void set_writer(ConfigWriter * w) {
+		writer = w;
+	}
+
 // Load functions
 	int get(const char * key, char * dest, const char * default_value, size_t max_size);
 
@@ -134,6 +238,22 @@ public:
 
 	int put_raw(const char * key, const void * dest, size_t data_size);
 
+// Bound keys
+	/**
+	 * Resolve @a key once: the handle returned reads its value, converted
+	 * as get() does (or @a default_value), with a single load. put(),
+	 * open() and reload() keep it up to date. Handles are valid as long as
+	 * the file; read them on the thread using the file.
+	 * T: one of the integer types, bool, double or float.
+	 */
+	template <class T>
+	handle<T> bind(const char * key, T const default_value) {
+		typed_binding<T> * const b = new typed_binding<T>(key, default_value);
+		b->refresh(*this);
+		bindings.push_back(b);
+		return handle<T>(&b->value);
+	}
+
 protected:
 	virtual int bin_decode(uint8_t *dst, const char *src, size_t dst_size) {
 		return AsciiBin::hex_to_binary(dst, src, dst_size);
@@ -143,16 +263,49 @@ protected:
 		return AsciiBin::binary_to_hex(dst, src, dst_size, src_size);
 	}
 
+	/**
+	 * Outcome of a background write (see set_writer()), 0 or -1. Called
+	 * from flush(), on the thread using the file.
+	 */
+	virtual void on_written(int result) {
+		(void)result;
+	}
+
+	/**
+	 * Copy on write: the dictionary is shared with the snapshot being
+	 * written, if any. Call before changing it.
+	 */
+	void own_dict();
+
 
 private:
+	struct write_request {
+		shared_ptr<const keyval_dict_t> snapshot;
+		string path;
+		string section;
+		uint64_t generation;   // Of the dictionary written
+		size_t journal_size;   // Journal records it holds
+		int result;
+		bool done;             // Set by the writer thread
+	};
+
+	static int write_dict(const keyval_dict_t & d, const char * filepath, const char * section);
+	int start_write();
+	void finish_write(bool wait);
+
 	int ini_parse_file(FILE*);
 	bool handle_key(const char*, const char*, const char*);
+	void set_modified();
+	void update_bindings(const char * key);
+	int replay_journal();
+	void append_journal(const char * key, const char * value);
+	int sync_journal(bool force);
 	
 //  MEMBER VARIABLES  ////////////////////////////////////////////////////////
 public:
 
 protected:
-	keyval_dict_t dict;
+	shared_ptr<keyval_dict_t> dict;
 
 private:
 	/* Maximum line length for any line in INI file. */
@@ -162,6 +315,18 @@ private:
 	const char * active_section;
 	bool modified;
 	bool update_on_destruction;
+	uint32_t flush_interval;  // ms
+	uint64_t modified_since;  // ms, monotonic: first change not written
+	string journal_path;
+	int journal_fd;           // -1 out of journal mode
+	size_t journal_size;      // Bytes appended since the last compaction
+	size_t journal_limit;
+	uint64_t unsynced_since;  // ms, monotonic: first record not synced, 0 if none
+	uint64_t generation;      // Changes since open
+	ConfigWriter * writer;
+	write_request * request;  // Background write, reused
+	bool write_in_flight;
+	vector<binding *> bindings;
 };
 
 
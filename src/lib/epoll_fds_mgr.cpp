@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
 #include "epoll_fds_mgr.hpp"
 
 
@@ -18,9 +19,12 @@
 /*************************************************************************//**
 **
 */
-EPollDescManager::EPollDescManager()
+EPollDescManager::EPollDescManager(unsigned const initial_size):
+	IOEventManager(initial_size)
 {
- 	fddesc_size = 16;
+	fddesc_size = (initial_size < MIN_POLL_SIZE) ? MIN_POLL_SIZE : initial_size;
+	ready_count = 0;
+	event_index = 0;
 
 	epoll_handle = epoll_create1(0);
 	if (epoll_handle < 0)
@@ -30,8 +34,6 @@ EPollDescManager::EPollDescManager()
 												sizeof(struct epoll_event));
 	if (epoll_fddesc == 0)
 		_ERROR() << "memory allocation error";
-
-	fddescs = new fddesc_pool(fddesc_size);
 }
 
 
@@ -40,10 +42,11 @@ EPollDescManager::EPollDescManager()
 */
 EPollDescManager::~EPollDescManager()
 {
+	free_released();
 	if (epoll_fddesc != 0)
 		free(epoll_fddesc);
-	
-	delete fddescs;
+	if (epoll_handle >= 0)
+		close(epoll_handle);
 }
 
 
@@ -62,20 +65,49 @@ void EPollDescManager::_dump_fds()
 
 
 /*************************************************************************//**
-**
+** Reallocate the buffer receiving ready events from epoll_wait. Never
+** called while events are being iterated, see wait_for_events().
 */
-void EPollDescManager::close_all()
+int EPollDescManager::resize_poll_buffer(unsigned const new_size)
 {
-	fddesc_info * t = fddescs->get_first();
-	while (t) {
-		if (t->flags & FDIF_VALID) {
-			int fd = t->fd;
-			rem_fd(t);
-			_VBL(2) << "close_all closing fd " << fd;
-			close(fd);
-		}
-		t = fddescs->get_next(t);
+	struct epoll_event * const p = (struct epoll_event *)realloc(epoll_fddesc,
+										new_size * sizeof(struct epoll_event));
+	if (p == 0) {
+		_ERROR() << "poll buffer resize to " << new_size << " failed";
+		return -1;
 	}
+	_VBL(2) << "poll buffer resized " << fddesc_size << " -> " << new_size;
+	epoll_fddesc = p;
+	fddesc_size = new_size;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Make room for one ready event per registered descriptor
+*/
+int EPollDescManager::grow_poll_buffer()
+{
+	unsigned new_size = fddesc_size;
+	while (new_size < fddescs->get_pool_usage())
+		new_size *= 2;
+	return resize_poll_buffer(new_size);
+}
+
+
+/*************************************************************************//**
+** Halve the buffer once usage has dropped below a quarter of it: the gap
+** between the two thresholds keeps a fluctuating load from reallocating
+** on every connect/disconnect.
+*/
+int EPollDescManager::trim_poll_buffer()
+{
+	unsigned new_size = fddesc_size;
+	while ((new_size / 2 >= MIN_POLL_SIZE) && (fddescs->get_pool_usage() < new_size / 4))
+		new_size /= 2;
+	if (new_size == fddesc_size)
+		return 0;
+	return resize_poll_buffer(new_size);
 }
 
 
@@ -87,16 +119,11 @@ int EPollDescManager::add_fd(int const fd, uint32_t const events, void * const u
 	struct epoll_event event;
 	struct fddesc_info * fdd_info;
 
-	fdd_info = alloc_fddinfo();
-	if (fdd_info == 0)
+	fdd_info = alloc_fddinfo(fd, events, udata, flags);
+	if (fdd_info == 0) {
+		_ERROR() << "no descriptor available for fd " << fd;
 		return -1;
-	
-	if (fddescs->get_pool_size() > fddesc_size)
-		grow_poll_buffer();
-
-	fdd_info->fd = fd;
-	fdd_info->flags = FDIF_VALID | flags;
-	fdd_info->uptr = udata;
+	}
 
 	event.events = events;
 	event.data.ptr = fdd_info;
@@ -107,6 +134,7 @@ int EPollDescManager::add_fd(int const fd, uint32_t const events, void * const u
 		free_fddinfo(fdd_info);
 		return -1;
 	}
+	fddescs->bind_fd(fdd_info);
 
 	return 0;
 }
@@ -119,7 +147,7 @@ int EPollDescManager::rem_fd(struct fddesc_info * const fddi)
 {
 	int rc;
 	
-	if (fddi == 0)
+	if ((fddi == 0) || ((fddi->flags & FDIF_VALID) == 0))
 		return -1;
 
 	rc = epoll_ctl(epoll_handle, EPOLL_CTL_DEL, fddi->fd, 0);
@@ -128,9 +156,20 @@ int EPollDescManager::rem_fd(struct fddesc_info * const fddi)
 		return -1;
 	}
 
-	free_fddinfo(fddi);
-	if (fddescs->get_pool_size() < fddesc_size)
-		trim_poll_buffer();
+	if (fddi->flags & FDIF_DEFERRED) {
+		for (size_t i = 0; i < deferred.size(); i++)
+			if (deferred[i] == fddi) {
+				deferred[i] = deferred.back();
+				deferred.pop_back();
+				break;
+			}
+	}
+
+	// Events of the current batch may still point to the descriptor: it is
+	// only freed before the next wait, see prepare_poll_buffer()
+	fddi->flags &= ~FDIF_VALID;
+	fddescs->unbind_fd(fddi);
+	released.push_back(fddi);
 	
 	return 0;
 }
@@ -139,45 +178,146 @@ int EPollDescManager::rem_fd(struct fddesc_info * const fddi)
 /*************************************************************************//**
 **
 */
-int EPollDescManager::rem_fd(struct epoll_event * const ev) {
-	if (ev == 0)
+int EPollDescManager::add_socket(int fd, void *udata, uint32_t flags)
+{
+	uint32_t events = EPOLLIN | EPOLLPRI;
+	
+	flags |= FDIF_VALID;
+	if (flags & FDIF_EDGE)
+		events |= EPOLLET;
+	
+	_VBL(3) <<  "fd:" << fd << " udata:" << udata <<
+				" svr:" << ((flags & FDIF_LISTENING) ? 'Y' : 'N') <<
+				" dgram:" << ((flags & FDIF_DATAGRAM) ? 'Y' : 'N') <<
+				" et:" << ((flags & FDIF_EDGE) ? 'Y' : 'N');
+	return add_fd(fd, events, udata, flags);
+}
+
+
+/*************************************************************************//**
+** Enable or disable EPOLLOUT notification for a registered descriptor.
+** Meant to be kept on only while there is pending output, otherwise
+** a level triggered socket would be reported writable on every loop.
+*/
+int EPollDescManager::set_output_interest(int const fd, bool const enable)
+{
+	struct fddesc_info * const fdd_info = find_fddinfo(fd);
+	if (fdd_info == 0)
+		return -1;
+	if (((fdd_info->flags & FDIF_OUTPUT) != 0) == enable)
+		return 0;
+	
+	struct epoll_event event;
+	event.events = fdd_info->events | (enable ? (uint32_t)EPOLLOUT : 0);
+	event.data.ptr = fdd_info;
+	if (epoll_ctl(epoll_handle, EPOLL_CTL_MOD, fd, &event) < 0) {
+		_LSYSERROR("EPOLL_CTL_MOD error");
 		return -1;
-	return rem_fd((struct fddesc_info *)ev->data.ptr);
+	}
+	if (enable)
+		fdd_info->flags |= FDIF_OUTPUT;
+	else
+		fdd_info->flags &= ~FDIF_OUTPUT;
+	return 0;
 }
 
 
 /*************************************************************************//**
-**
+** Report the descriptor as ready again on the next wait_for_events() call.
+** Used for edge triggered descriptors whose handler stopped before having
+** drained them: the kernel will not notify them again until new data comes.
 */
-int EPollDescManager::rem_fd(int const fd, void **uptr)
+int EPollDescManager::defer_fd(int const fd)
 {
-	struct fddesc_info * fdd_info = find_fddinfo(fd);
+	struct fddesc_info * const fdd_info = find_fddinfo(fd);
+	if (fdd_info == 0)
+		return -1;
+	if ((fdd_info->flags & FDIF_DEFERRED) == 0) {
+		fdd_info->flags |= FDIF_DEFERRED;
+		deferred.push_back(fdd_info);
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Append deferred descriptors to the ready events returned by the kernel,
+** skipping those the kernel has already reported.
+*/
+void EPollDescManager::append_deferred_events()
+{
+	if (deferred.empty())
+		return;
 	
-	if (uptr != 0)
-		*uptr = 0;
+	for (int i = 0; i < ready_count; i++)
+		((struct fddesc_info *)epoll_fddesc[i].data.ptr)->flags &= ~FDIF_DEFERRED;
 	
-	if (fdd_info != 0) {
-		if (uptr != 0)
-			*uptr = fdd_info->uptr;
-		
-		return rem_fd(fdd_info);
+	size_t kept = 0;
+	for (size_t i = 0; i < deferred.size(); i++) {
+		struct fddesc_info * const fddi = deferred[i];
+		if ((fddi->flags & FDIF_DEFERRED) == 0)
+			continue;
+		if ((unsigned)ready_count >= fddesc_size) {
+			// No room left (poll buffer could not grow): retry next time
+			deferred[kept++] = fddi;
+			continue;
+		}
+		fddi->flags &= ~FDIF_DEFERRED;
+		epoll_fddesc[ready_count].events = EPOLLIN;
+		epoll_fddesc[ready_count].data.ptr = fddi;
+		ready_count++;
 	}
-	_VBL(4) << "rem_fd no descriptor for fd " << fd;
-	
-	return -1;
+	deferred.resize(kept);
 }
 
 
 /*************************************************************************//**
-**
+** Convert the poll timeout to milliseconds (null: no timeout); don't block
+** at all if some deferred descriptor is waiting to be served.
 */
-int EPollDescManager::add_socket(int fd, void *udata, bool is_server)
+int EPollDescManager::poll_timeout(struct timespec const * const tout) const
 {
-	uint32_t events = EPOLLIN | EPOLLPRI; // EPOLLET; // Make fd events edge triggered
-	uint32_t flags = FDIF_VALID | (is_server ? FDIF_LISTENING : 0);
-	
-	_VBL(3) <<  "fd:" << fd << " udata:" << udata << " svr:" << (is_server ? 'Y' : 'N');
-	return add_fd(fd, events, udata, flags);
+	if (!deferred.empty())
+		return 0;
+	if (tout == 0)
+		return -1;
+	return tout->tv_sec * 1000 + tout->tv_nsec / 1000000;
+}
+
+
+/*************************************************************************//**
+** Free the descriptors removed during the previous batch
+*/
+void EPollDescManager::free_released()
+{
+	for (size_t i = 0; i < released.size(); i++)
+		free_fddinfo(released[i]);
+	released.clear();
+}
+
+
+/*************************************************************************//**
+** Adjust the event buffer to the number of registered descriptors.
+** Done here, before waiting, because add_fd()/rem_fd() are typically
+** invoked from within the event loop while the buffer is being iterated.
+** Same for the descriptor pool: removed descriptors are only freed, and
+** idle chunks given back, here, once no ready event of the previous batch
+** points to them any more.
+** @return the number of events the buffer can hold, 0 if no fd is registered
+*/
+int EPollDescManager::prepare_poll_buffer()
+{
+	free_released();
+	fddescs->trim();
+	unsigned const usage = fddescs->get_pool_usage();
+	if (usage == 0)
+		return 0;
+	if (usage > fddesc_size)
+		grow_poll_buffer();
+	else
+	if (usage < fddesc_size / 4)
+		trim_poll_buffer();
+	return fddesc_size;
 }
 
 
@@ -187,19 +327,22 @@ int EPollDescManager::add_socket(int fd, void *udata, bool is_server)
 EPollDescManager::event_iterator
 EPollDescManager::wait_for_events(struct timespec *tout, sigset_t *blksig)
 {
-	int timeout = tout->tv_sec * 1000 + tout->tv_nsec / 1000000;
-	int maxevents = fddescs->get_pool_size();
+	int timeout = poll_timeout(tout);
+	int maxevents = prepare_poll_buffer();
 	
 	if (maxevents <= 0) {
-		nanosleep(tout, 0);
+		if (tout != 0)
+			nanosleep(tout, 0);
 		return 0;
 	}
 	
 	ready_count = epoll_pwait(epoll_handle, epoll_fddesc, maxevents, timeout, blksig);
 	if (ready_count == -1) {
-		_LSYSERROR("epoll_pwait error");
+		if (errno != EINTR) // Signal handled, e.g. a stop request
+			_LSYSERROR("epoll_pwait error");
 		ready_count = 0;
 	}
+	append_deferred_events();
 	return ready_count;
 }
 
@@ -207,22 +350,64 @@ EPollDescManager::wait_for_events(struct timespec *tout, sigset_t *blksig)
 EPollDescManager::event_iterator
 EPollDescManager::wait_for_events(struct timespec *tout)
 {
-	int timeout = tout->tv_sec * 1000 + tout->tv_nsec / 1000000;
-	int maxevents = fddescs->get_pool_size();
+	int timeout = poll_timeout(tout);
+	int maxevents = prepare_poll_buffer();
 	
 	if (maxevents <= 0) {
-		nanosleep(tout, 0);
+		if (tout != 0)
+			nanosleep(tout, 0);
 		return 0;
 	}
 	
 	ready_count = epoll_wait(epoll_handle, epoll_fddesc, maxevents, timeout);
 	if (ready_count == -1) {
-		_LSYSERROR("epoll_wait error");
+		if (errno != EINTR) // Signal handled, e.g. a stop request
+			_LSYSERROR("epoll_wait error");
 		ready_count = 0;
 	}
+	append_deferred_events();
 	return ready_count;
 }
 
+/*************************************************************************//**
+** Present a ready epoll event in the backend independent format
+*/
+EPollDescManager::event_descriptor
+EPollDescManager::fill_event(int const index)
+{
+	struct epoll_event const * const ev = epoll_fddesc + index;
+	struct fddesc_info * const fddi = (struct fddesc_info *)ev->data.ptr;
+	current.fd = fddi->fd;
+	current.events = ev->events;
+	current.flags = fddi->flags;
+	current.udata = fddi->uptr;
+	current.desc = fddi;
+	current.accepted_fd = -1;
+	current.rx_data = 0;
+	current.rx_result = 0;
+	current.rx_completed = false;
+	return &current;
+}
+
+
+/*************************************************************************//**
+** Skip events of descriptors removed while the batch was being served: they
+** stay allocated, flagged not valid, until the next wait, so their slab
+** cannot have been handed out again to a descriptor accepted meanwhile.
+*/
+EPollDescManager::event_descriptor
+EPollDescManager::valid_event()
+{
+	while (event_index < ready_count) {
+		struct fddesc_info * const fddi = (struct fddesc_info *)epoll_fddesc[event_index].data.ptr;
+		if (fddi->flags & FDIF_VALID)
+			return fill_event(event_index);
+		event_index++;
+	}
+	return 0;
+}
+
+
 /*************************************************************************//**
 **
 */
@@ -230,7 +415,7 @@ EPollDescManager::event_descriptor
 EPollDescManager::get_first_event()
 {
 	event_index = 0;
-	return static_cast<event_descriptor>(epoll_fddesc);
+	return valid_event();
 }
 
 
@@ -238,8 +423,5 @@ EPollDescManager::event_descriptor
 EPollDescManager::get_next_event()
 {
 	event_index++;
-	if (event_index >= ready_count)
-		return 0;
-	
-	return static_cast<event_descriptor>(epoll_fddesc + event_index);
+	return valid_event();
 }
@@ -0,0 +1,56 @@
+/**
+******************************************************************************
+* @file    flat_dict.cpp
+*****************************************************************************/
+
+#include "flat_dict.hpp"
+
+
+/*************************************************************************//**
+** The table is kept at most half full: probe sequences stay short
+*/
+FlatDict::entry * FlatDict::insert(str_ref const key, str_ref const value, bool const replace)
+{
+	entry * e = find(key);
+	if (e != 0) {
+		if (replace)
+			set_value(e, value);
+		return e;
+	}
+
+	if ((entries.size() + 1) * 2 > slots.size())
+		rehash(slots.empty() ? 16 : slots.size() * 2);
+
+	entries.push_back(entry());
+	e = &entries.back();
+	e->key.assign(key.data, key.size);
+	e->value.assign(value.data, value.size);
+	e->hash = hash_of(key);
+	e->cached = 0;
+	e->i64 = 0;
+	e->u64 = 0;
+	e->f64 = 0;
+
+	uint32_t i = e->hash & mask;
+	while (slots[i] != 0)
+		i = (i + 1) & mask;
+	slots[i] = entries.size();
+	return e;
+}
+
+
+/*************************************************************************//**
+** @a capacity: power of two
+*/
+void FlatDict::rehash(size_t const capacity)
+{
+	slots.assign(capacity, 0);
+	mask = capacity - 1;
+	for (size_t n = 0; n < entries.size(); n++) {
+		uint32_t i = entries[n].hash & mask;
+		while (slots[i] != 0)
+			i = (i + 1) & mask;
+		slots[i] = n + 1;
+	}
+	entries.reserve(capacity / 2);
+}
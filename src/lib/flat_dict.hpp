@@ -0,0 +1,170 @@
+/**
+******************************************************************************
+* @file    flat_dict.hpp
+* @brief   Open addressing string dictionary with a parsed value cache
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __FLAT_DICT_HPP_INCLUDED
+#define __FLAT_DICT_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error flat_dict.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/*************************************************************************//**
+** Borrowed string: lookups from a C string or a std::string without
+** building a std::string key
+*/
+struct str_ref {
+	str_ref(const char * s):
+		data(s),
+		size(strlen(s))
+	{}
+	str_ref(const char * s, size_t n):
+		data(s),
+		size(n)
+	{}
+	str_ref(const string & s):
+		data(s.data()),
+		size(s.size())
+	{}
+
+	const char * data;
+	size_t size;
+};
+
+
+/*************************************************************************//**
+**
+** Dictionary of string keys and values: entries are stored contiguously, in
+** insertion order, and found through an open addressing table (linear
+** probing) of entry indexes. Each key is stored once, in its entry; a
+** lookup hashes the key it is given, and compares it with the keys of the
+** same hash only: no allocation.
+**
+** Entries also cache the value parsed as a number by the reader (see
+** ConfigFile::get()): the cache is cleared when the value changes. It is
+** mutable, so that readers of a const dictionary may fill it in.
+**
+** Entries are never removed; pointers to them stay valid until the next
+** insertion.
+**
+*****************************************************************************/
+
+class FlatDict
+{
+public:
+	enum cache_flags {
+		CACHED_INT64  = (1 << 0),  // Parsed as a signed integer
+		VALID_INT64   = (1 << 1),  // ... successfully
+		CACHED_UINT64 = (1 << 2),
+		VALID_UINT64  = (1 << 3),
+		CACHED_DOUBLE = (1 << 4),
+		VALID_DOUBLE  = (1 << 5)
+	};
+
+	struct entry {
+		string key;
+		string value;
+		uint32_t hash;
+		mutable uint32_t cached;  // cache_flags
+		mutable int64_t i64;
+		mutable uint64_t u64;
+		mutable double f64;
+	};
+
+	typedef vector<entry>::const_iterator const_iterator;
+
+	FlatDict():
+		mask(0)
+	{}
+
+	entry * find(str_ref const key) {
+		return const_cast<entry *>(static_cast<FlatDict const *>(this)->find(key));
+	}
+	entry const * find(str_ref const key) const {
+		if (slots.empty())
+			return 0;
+		uint32_t const h = hash_of(key);
+		for (uint32_t i = h & mask; slots[i] != 0; i = (i + 1) & mask) {
+			entry const & e = entries[slots[i] - 1];
+			if ((e.hash == h) && (e.key.size() == key.size) &&
+				(memcmp(e.key.data(), key.data, key.size) == 0))
+				return &e;
+		}
+		return 0;
+	}
+
+	/**
+	 * Add @a key, or change its value if @a replace
+	 * @return the entry of @a key
+	 */
+	entry * insert(str_ref key, str_ref value, bool replace);
+
+	void set_value(entry * const e, str_ref const value) {
+		e->value.assign(value.data, value.size);
+		e->cached = 0;
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+	const_iterator begin() const {
+		return entries.begin();
+	}
+	const_iterator end() const {
+		return entries.end();
+	}
+
+private:
+	/**
+	 * FNV-1a
+	 */
+	static uint32_t hash_of(str_ref const key) {
+		uint32_t h = 2166136261u;
+		for (size_t i = 0; i < key.size; i++)
+			h = (h ^ (uint8_t)key.data[i]) * 16777619u;
+		return h;
+	}
+
+	void rehash(size_t capacity);
+
+private:
+	vector<entry> entries;
+	vector<uint32_t> slots;  // Entry index + 1, 0 if free
+	uint32_t mask;
+};
+
+
+/****************************************************************************/
+
+#endif /* __FLAT_DICT_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,100 @@
+/**
+******************************************************************************
+* @file    io_event_mgr.cpp
+*****************************************************************************/
+
+#include "io_event_mgr.hpp"
+#include "epoll_fds_mgr.hpp"
+#include "uring_event_mgr.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+** Instantiate the requested backend. io_uring needs kernel support
+** (6.0 or later for the multishot operations); when it is missing the
+** epoll backend is used instead.
+*/
+IOEventManager * IOEventManager::create(backend_type const backend)
+{
+	if (backend == BACKEND_IO_URING) {
+#ifdef HAVE_IO_URING
+		URingEventManager * const mgr = new URingEventManager();
+		if (mgr->is_ready())
+			return mgr;
+		delete mgr;
+#endif
+		_WARNING() << "io_uring backend not available, using epoll";
+	}
+	return new EPollDescManager();
+}
+
+
+/*************************************************************************//**
+**
+*/
+IOEventManager::IOEventManager(unsigned const initial_size)
+{
+	fddescs = new fddesc_pool((initial_size < MIN_POLL_SIZE) ? MIN_POLL_SIZE : initial_size);
+}
+
+
+/*************************************************************************//**
+**
+*/
+IOEventManager::~IOEventManager()
+{
+	delete fddescs;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int IOEventManager::rem_fd(int const fd, void **uptr)
+{
+	struct fddesc_info * fdd_info = find_fddinfo(fd);
+
+	if (uptr != 0)
+		*uptr = 0;
+
+	if (fdd_info != 0) {
+		if (uptr != 0)
+			*uptr = fdd_info->uptr;
+
+		return rem_fd(fdd_info);
+	}
+	_VBL(4) << "rem_fd no descriptor for fd " << fd;
+
+	return -1;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int IOEventManager::rem_socket(event_descriptor const ev)
+{
+	return rem_fd(ev->desc);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void IOEventManager::close_all()
+{
+	// Allocated descriptors only; those a completion backend keeps for
+	// requests still in flight are no longer valid
+	fddesc_info * next;
+	for (fddesc_info * t = fddescs->get_first(); t != 0; t = next) {
+		next = fddescs->get_next(t);
+		if (t->flags & FDIF_VALID) {
+			int const fd = t->fd;
+			rem_fd(t);
+			_VBL(2) << "close_all closing fd " << fd;
+			close(fd);
+		}
+	}
+}
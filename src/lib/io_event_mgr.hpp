@@ -0,0 +1,312 @@
+/**
+******************************************************************************
+* @file    io_event_mgr.hpp
+* @brief   Interface of the I/O event sources driving a SocketServer
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __IOEVENTMGR_HPP_INCLUDED
+#define __IOEVENTMGR_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error io_event_mgr.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <vector>
+#include <pool_allocator.hpp>
+
+using namespace std;
+
+
+/*************************************************************************//**
+**
+** An event manager tracks registered descriptors and reports their events
+** one batch at a time: wait_for_events(), then get_first_event() /
+** get_next_event() until null.
+**
+** Readiness backends (epoll) only report that a descriptor can be read,
+** and the server performs the accept/recv. Completion backends (io_uring)
+** perform the operation themselves: the event then carries the accepted
+** socket or the received bytes, see io_event::accepted_fd and
+** io_event::has_rx_data().
+**
+*****************************************************************************/
+
+class IOEventManager {
+public:
+	enum backend_type {
+		BACKEND_EPOLL,
+		BACKEND_IO_URING
+	};
+
+	static const uint32_t FDIF_NONSOCKET  = (1L << 2);
+	static const uint32_t FDIF_COUNTER    = (1L << 7); // eventfd, timerfd
+	static const unsigned MIN_POLL_SIZE   = 16;
+
+protected:
+	static const uint32_t FDIF_VALID      = (1L << 0);
+	static const uint32_t FDIF_LISTENING  = (1L << 1);
+	static const uint32_t FDIF_EDGE       = (1L << 3);
+	static const uint32_t FDIF_DEFERRED   = (1L << 4);
+	static const uint32_t FDIF_DATAGRAM   = (1L << 5);
+	static const uint32_t FDIF_OUTPUT     = (1L << 6);
+
+	struct fddesc_info {
+		fddesc_info():
+			fd(-1), flags(0), events(0), pending_ops(0), uptr(0)
+		{}
+		fddesc_info(int const _fd, uint32_t const _flags, uint32_t const _events, void * const _uptr):
+			fd(_fd), flags(_flags), events(_events), pending_ops(0), uptr(_uptr)
+		{}
+		~fddesc_info() {
+			flags = 0;
+		}
+		int fd;
+		uint32_t flags;
+		uint32_t events;
+		uint32_t pending_ops; // Completion backends: requests in flight
+		void * uptr;
+	};
+
+	typedef PoolAllocator<fddesc_info> FDDesc_PoolAllocator;
+	class FDDescAllocator : public FDDesc_PoolAllocator {
+		friend class IOEventManager;
+	public:
+		FDDescAllocator(size_t _size):
+			FDDesc_PoolAllocator(_size),
+			fd_table(_size, 0),
+			trim_pending(false) {
+			set_pool_name("fd descriptors");
+		}
+
+		fddesc_info * find_fd(int const fd) const {
+			if ((fd < 0) || ((size_t)fd >= fd_table.size()))
+				return 0;
+			return fd_table[fd];
+		}
+
+		void bind_fd(fddesc_info * const fddi) {
+			size_t const idx = fddi->fd;
+			if (idx >= fd_table.size()) {
+				size_t new_size = fd_table.size() ? fd_table.size() : 16;
+				while (new_size <= idx)
+					new_size *= 2;
+				fd_table.resize(new_size, 0);
+			}
+			fd_table[idx] = fddi;
+		}
+
+		void unbind_fd(fddesc_info * const fddi) {
+			if (find_fd(fddi->fd) == fddi)
+				fd_table[fddi->fd] = 0;
+		}
+
+		int get_table_size() const {
+			return fd_table.size();
+		}
+
+		// Give back the idle chunks, if descriptors were freed since the last
+		// call. Invoked by the backends before waiting, when no event of the
+		// previous batch is referenced any more.
+		void trim() {
+			if (!trim_pending)
+				return;
+			trim_pending = false;
+			trim_idle_chunks();
+		}
+
+	protected:
+		// Double the pool capacity in a new chunk: descriptors already
+		// registered with the kernel (epoll data.ptr) are not moved.
+		void grow_pool() {
+			add_chunk(get_pool_size() ? get_pool_size() : MIN_POLL_SIZE);
+		}
+		// Chunks emptied once a connection burst is over are not given back
+		// here: the descriptor may be freed while the backend iterates a
+		// batch of events that still point into its chunk (see trim())
+		void trim_pool() {
+			trim_pending = true;
+		}
+
+	private:
+		// The kernel always hands out the lowest free descriptor number,
+		// so fds are small and dense: a plain array indexed by fd gives
+		// constant time lookup without hashing.
+		vector<fddesc_info *> fd_table;
+		bool trim_pending;
+	};
+
+	typedef FDDescAllocator fddesc_pool;
+
+	struct io_event {
+		int fd;
+		uint32_t events;
+		uint32_t flags;
+		void * udata;
+		struct fddesc_info * desc;
+		// Completion backends only
+		int accepted_fd;
+		const uint8_t * rx_data;
+		ssize_t rx_result;
+		bool rx_completed;
+
+		bool is_signal() const {
+			return (flags & FDIF_NONSOCKET) != 0;
+		}
+		bool is_counter() const {
+			return (flags & FDIF_COUNTER) != 0;
+		}
+		bool is_error() const {
+			return (events & POLLERR);
+		}
+		bool is_hangup() const {
+			return (events & POLLHUP);
+		}
+		bool is_incoming_connection() const {
+			return (events & (POLLIN|POLLPRI)) && (flags & FDIF_LISTENING);
+		}
+		bool is_incoming_data() const {
+			return (events & (POLLIN|POLLPRI));
+		}
+		bool is_output_ready() const {
+			return (events & POLLOUT);
+		}
+		bool has_priority() const {
+			return (events & POLLPRI);
+		}
+		bool is_edge_triggered() const {
+			return (flags & FDIF_EDGE) != 0;
+		}
+		bool is_datagram() const {
+			return (flags & FDIF_DATAGRAM) != 0;
+		}
+		/**
+		 * The backend already received data: rx_result holds the byte
+		 * count (data at rx_data), 0 on EOF, or -errno
+		 */
+		bool has_rx_data() const {
+			return rx_completed;
+		}
+		int get_fd() const {
+			return fd;
+		}
+		void* get_udata() const {
+			return udata;
+		}
+		int rem_socket(IOEventManager * mgr) {
+			return mgr->rem_socket(this);
+		};
+	};
+
+public:
+	enum event_flags {
+		EV_IN  = POLLIN,  /* There is data to read.  */
+		EV_PRI = POLLPRI, /* There is urgent data to read.  */
+		EV_OUT = POLLOUT, /* Writing now will not block.  */
+		EV_RDNORM = POLLRDNORM, /* Normal data may be read.  */
+		EV_RDBAND = POLLRDBAND, /* Priority data may be read.  */
+		EV_WRNORM = POLLWRNORM, /* Writing now will not block.  */
+		EV_WRBAND = POLLWRBAND, /* Priority data may be written.  */
+		EV_MSG   = POLLMSG,
+		EV_ERR   = POLLERR,  /* Error condition.  */
+		EV_HUP   = POLLHUP,  /* Hung up.  */
+		EV_RDHUP = POLLRDHUP
+	};
+	static const uint32_t ERROR_EVENT = 0xFFFFFFFFU;
+	typedef uint32_t event_iterator;
+	typedef struct io_event * event_descriptor;
+
+public:
+	static IOEventManager * create(backend_type backend);
+
+	IOEventManager(unsigned initial_size);
+	virtual ~IOEventManager();
+
+	virtual int add_fd(int fd, uint32_t events, void * udata, uint32_t flags) = 0;
+	virtual int rem_fd(int fd, void**);
+	virtual int rem_socket(event_descriptor ev);
+
+	void* get_fd_udata(int const fd) {
+		struct fddesc_info * fdd_info = find_fddinfo(fd);
+		if (fdd_info == 0)
+			return 0;
+		return fdd_info->uptr;
+	}
+
+	int add_socket(int const fd, void * const udata, bool const edge_triggered = false) {
+		return add_socket(fd, udata, edge_triggered ? FDIF_EDGE : 0);
+	}
+	int add_server_socket(int const fd, void * const udata, bool const edge_triggered = false) {
+		return add_socket(fd, udata, FDIF_LISTENING | (edge_triggered ? FDIF_EDGE : 0));
+	}
+	int add_datagram_socket(int const fd, void * const udata, bool const edge_triggered = false) {
+		return add_socket(fd, udata, FDIF_DATAGRAM | (edge_triggered ? FDIF_EDGE : 0));
+	}
+	int rem_socket(int const fd) {
+		return rem_fd(fd, 0);
+	}
+	virtual int set_output_interest(int fd, bool enable) = 0;
+
+	/**
+	 * Wait at most @a tout (null: until some event comes) for events
+	 */
+	virtual event_iterator wait_for_events(struct timespec * tout) = 0;
+
+	virtual event_descriptor get_first_event() = 0;
+	virtual event_descriptor get_next_event() = 0;
+
+	/**
+	 * Report @a fd again on the next wait even if the kernel doesn't
+	 * (readiness backends, edge triggered mode)
+	 */
+	virtual int defer_fd(int) {
+		return 0;
+	}
+
+	void close_all();
+
+protected:
+	virtual int add_socket(int fd, void *udata, uint32_t flags) = 0;
+	virtual int rem_fd(struct fddesc_info * fddi) = 0;
+
+	inline struct fddesc_info* alloc_fddinfo(int const fd, uint32_t const events, void * const udata, uint32_t const flags) {
+		return fddescs->emplace(fd, FDIF_VALID | flags, events, udata);
+	}
+	inline void free_fddinfo(struct fddesc_info * fddi_ptr) {
+		fddescs->free_object(fddi_ptr);
+	}
+	inline struct fddesc_info* find_fddinfo(int const fd) {
+		return fddescs->find_fd(fd);
+	}
+
+protected:
+	fddesc_pool * fddescs;
+};
+
+/****************************************************************************/
+
+#endif /* __IOEVENTMGR_HPP_INCLUDED */
+/* EOF */
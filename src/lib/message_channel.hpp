@@ -0,0 +1,292 @@
+/**
+******************************************************************************
+* @file    message_channel.hpp
+* @brief   Lock-free message channel from any thread to a SocketServer
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __MESSAGE_CHANNEL_HPP_INCLUDED
+#define __MESSAGE_CHANNEL_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error message_channel.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <new>
+#include <sys/eventfd.h>
+#include "sock_server.hpp"
+
+#include <logging.hpp>
+
+#ifdef LOG_SUBSYSTEM_ID
+#undef LOG_SUBSYSTEM_ID
+#endif
+#define LOG_SUBSYSTEM_ID "default"
+
+
+#define CHANNEL_CACHE_LINE 64
+
+
+/*************************************************************************//**
+**
+** Bounded multi producer queue (D. Vyukov's array queue): every cell
+** carries a sequence number telling whether it is free for the producer
+** of a given position or full for the consumer of that position, so that
+** a push or a pop is a single compare and swap on the position counter
+** plus one store. With a single producer the CAS never fails, which makes
+** it a plain SPSC ring.
+**
+** The capacity is rounded up to a power of two. T is copied in and out.
+**
+*****************************************************************************/
+
+template <class T>
+class BoundedQueue
+{
+public:
+	BoundedQueue(unsigned const capacity):
+		cells(0),
+		mask(0),
+		enqueue_pos(0),
+		dequeue_pos(0)
+	{
+		unsigned size = 2;
+		while (size < capacity)
+			size <<= 1;
+		cells = static_cast<cell *>(calloc(size, sizeof(cell)));
+		if (cells == 0)
+			return;
+		for (unsigned i = 0; i < size; i++) {
+			new (&cells[i].data) T();
+			cells[i].sequence = i;
+		}
+		mask = size - 1;
+	}
+
+	~BoundedQueue() {
+		if (cells == 0)
+			return;
+		for (unsigned i = 0; i <= mask; i++)
+			cells[i].data.~T();
+		free(cells);
+	}
+
+	bool is_ready() const {
+		return cells != 0;
+	}
+	unsigned get_capacity() const {
+		return cells ? mask + 1 : 0;
+	}
+
+	/**
+	 * Any thread
+	 * @return false if the queue is full
+	 */
+	bool push(T const & msg) {
+		if (cells == 0)
+			return false;
+		uint32_t pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		for (;;) {
+			cell * const c = &cells[pos & mask];
+			uint32_t const seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+			int32_t const diff = (int32_t)(seq - pos);
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true,
+												__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+					c->data = msg;
+					__atomic_store_n(&c->sequence, pos + 1, __ATOMIC_RELEASE);
+					return true;
+				}
+				// pos reloaded by the failed CAS
+			} else
+			if (diff < 0)
+				return false; // Full: the consumer is a lap behind
+			else
+				pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	/**
+	 * Consumer thread only
+	 * @return false if the queue is empty
+	 */
+	bool pop(T & msg) {
+		if (cells == 0)
+			return false;
+		uint32_t const pos = dequeue_pos;
+		cell * const c = &cells[pos & mask];
+		uint32_t const seq = __atomic_load_n(&c->sequence, __ATOMIC_ACQUIRE);
+		if ((int32_t)(seq - (pos + 1)) < 0)
+			return false; // Empty, or the producer of pos is not done yet
+		msg = c->data;
+		__atomic_store_n(&c->sequence, pos + mask + 1, __ATOMIC_RELEASE);
+		dequeue_pos = pos + 1;
+		return true;
+	}
+
+private:
+	struct cell {
+		uint32_t sequence;
+		T data;
+	};
+
+	BoundedQueue(BoundedQueue const &);
+	BoundedQueue & operator=(BoundedQueue const &);
+
+private:
+	cell * cells;
+	uint32_t mask;
+	// Producers and consumer each write their own cache line
+	uint8_t pad0[CHANNEL_CACHE_LINE];
+	uint32_t enqueue_pos;
+	uint8_t pad1[CHANNEL_CACHE_LINE - sizeof(uint32_t)];
+	uint32_t dequeue_pos;
+};
+
+
+/*************************************************************************//**
+**
+** Channel delivering messages of type T, posted from any thread, to the
+** thread running a SocketServer (the consumer). Messages travel through a
+** BoundedQueue; an eventfd registered in the consumer's event manager
+** wakes it up, and on_message() is then called, on the consumer thread,
+** for every queued message.
+**
+** Producers only write the eventfd when the consumer has not been
+** notified yet since its last drain, so a burst of posts costs a single
+** system call and wakeup.
+**
+** Create and delete the channel on the consumer thread, or while its
+** server is not running.
+**
+*****************************************************************************/
+
+template <class T>
+class MessageChannel : public SocketHandler
+{
+public:
+	static const unsigned DEFAULT_CAPACITY = 256;
+
+	MessageChannel(SocketServer * const consumer, unsigned const capacity = DEFAULT_CAPACITY):
+		SocketHandler(consumer),
+		queue(capacity),
+		event_fd(-1),
+		notified(false)
+	{
+		if (!queue.is_ready()) {
+			_ERROR() << "MessageChannel @" << this << " cannot allocate " << capacity << " messages";
+			return;
+		}
+		event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (event_fd < 0) {
+			_LSYSERROR("eventfd error");
+			return;
+		}
+		if (consumer->add_event_fd(this, event_fd) != 0) {
+			_ERROR() << "MessageChannel @" << this << " cannot register fd " << event_fd;
+			close(event_fd);
+			event_fd = -1;
+		}
+	}
+
+	virtual ~MessageChannel() {
+		if (event_fd >= 0) {
+			get_server()->rem_fd(event_fd);
+			close(event_fd);
+		}
+	}
+
+	bool is_ready() const {
+		return event_fd >= 0;
+	}
+	unsigned get_capacity() const {
+		return queue.get_capacity();
+	}
+
+	/**
+	 * Queue @a msg for the consumer; any thread
+	 * @return 0 on success, -1 if the channel is full (or not ready)
+	 */
+	int post(T const & msg) {
+		if ((event_fd < 0) || !queue.push(msg))
+			return -1;
+		wake();
+		return 0;
+	}
+
+	/**
+	 * Message received, on the consumer thread
+	 */
+	virtual void on_message(T & msg) = 0;
+
+	int on_event(int, uint64_t) {
+		// Cleared before draining: a message posted from now on either is
+		// drained below or notifies again
+		(void)__atomic_exchange_n(&notified, false, __ATOMIC_ACQ_REL);
+
+		// Bounded batch, so that fast producers can't starve the other
+		// descriptors of the consumer
+		T msg;
+		unsigned const limit = queue.get_capacity();
+		unsigned count = 0;
+		while ((count < limit) && queue.pop(msg)) {
+			on_message(msg);
+			count++;
+		}
+		if ((count == limit) && !__atomic_exchange_n(&notified, true, __ATOMIC_ACQ_REL))
+			notify(); // Come back for the rest after the others
+		return 0;
+	}
+
+protected:
+	/**
+	 * Have on_event() called on the consumer thread, unless already due;
+	 * any thread. What was written before is seen by on_event().
+	 */
+	void wake() {
+		// Release to the consumer's exchange in on_event()
+		if (!__atomic_exchange_n(&notified, true, __ATOMIC_ACQ_REL))
+			notify();
+	}
+
+private:
+	void notify() {
+		uint64_t const one = 1;
+		ssize_t const res = write(event_fd, &one, sizeof(one));
+		(void)res; // A full counter is still readable
+	}
+
+private:
+	BoundedQueue<T> queue;
+	int event_fd;
+	bool notified;
+};
+
+
+/****************************************************************************/
+#undef LOG_SUBSYSTEM_ID
+
+#endif /* __MESSAGE_CHANNEL_HPP_INCLUDED */
+/* EOF */
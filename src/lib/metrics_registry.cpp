@@ -0,0 +1,140 @@
+/**
+******************************************************************************
+* @file    metrics_registry.cpp
+*****************************************************************************/
+
+#include <algorithm>
+#include "metrics_registry.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+**
+*/
+void MetricsSource::add_gauge(metric_samples_t & out, std::string const & name, uint64_t const value)
+{
+	metric_sample s;
+	s.name = name;
+	s.value = value;
+	s.counter = false;
+	s.rate = 0;
+	out.push_back(s);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void MetricsSource::add_counter(metric_samples_t & out, std::string const & name, uint64_t const value)
+{
+	add_gauge(out, name, value);
+	out.back().counter = true;
+}
+
+
+/*************************************************************************//**
+** Created on first use and never deleted: sources in static objects may
+** still unregister at exit
+*/
+MetricsRegistry & MetricsRegistry::instance()
+{
+	static MetricsRegistry * const registry = new MetricsRegistry;
+	return *registry;
+}
+
+
+/*************************************************************************//**
+**
+*/
+MetricsRegistry::MetricsRegistry()
+{
+	pthread_mutex_init(&mutex, 0);
+	clock_gettime(CLOCK_MONOTONIC, &last_time);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void MetricsRegistry::add_source(MetricsSource * const source)
+{
+	if (source == 0)
+		return;
+	pthread_mutex_lock(&mutex);
+	if (std::find(sources.begin(), sources.end(), source) == sources.end())
+		sources.push_back(source);
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/*************************************************************************//**
+** Forget its counters as well: another source may get the same address
+*/
+void MetricsRegistry::rem_source(MetricsSource * const source)
+{
+	pthread_mutex_lock(&mutex);
+	std::vector<MetricsSource *>::iterator const it = std::find(sources.begin(), sources.end(), source);
+	if (it != sources.end())
+		sources.erase(it);
+	last_counters.erase(last_counters.lower_bound(counter_key_t(source, std::string())),
+						last_counters.lower_bound(counter_key_t(source + 1, std::string())));
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/*************************************************************************//**
+** Rates are 0 for counters seen for the first time
+*/
+void MetricsRegistry::snapshot(metric_samples_t & out)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&mutex);
+	double const elapsed = (now.tv_sec - last_time.tv_sec) + (now.tv_nsec - last_time.tv_nsec) / 1e9;
+	last_time = now;
+	metric_samples_t samples;
+	for (size_t i = 0; i < sources.size(); i++) {
+		MetricsSource const * const source = sources[i];
+		samples.clear();
+		source->report_metrics(samples);
+		std::string const prefix = source->get_metrics_name() + ".";
+		for (size_t j = 0; j < samples.size(); j++) {
+			metric_sample & s = samples[j];
+			if (s.counter) {
+				std::pair<std::map<counter_key_t, uint64_t>::iterator, bool> const r =
+					last_counters.insert(std::make_pair(counter_key_t(source, s.name), s.value));
+				if (!r.second) {
+					if ((elapsed > 0) && (s.value >= r.first->second))
+						s.rate = (s.value - r.first->second) / elapsed;
+					r.first->second = s.value;
+				}
+			}
+			s.name = prefix + s.name;
+			out.push_back(s);
+		}
+	}
+	pthread_mutex_unlock(&mutex);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void MetricsRegistry::dump()
+{
+	if (!VLOG_IS_ON(1))
+		return;
+	metric_samples_t samples;
+	snapshot(samples);
+	for (size_t i = 0; i < samples.size(); i++) {
+		metric_sample const & s = samples[i];
+		if (s.counter) {
+			_VBL(1) << "metric " << s.name << " " << s.value << " (" << s.rate << "/s)";
+		} else {
+			_VBL(1) << "metric " << s.name << " " << s.value;
+		}
+	}
+}
@@ -0,0 +1,120 @@
+/**
+******************************************************************************
+* @file    metrics_registry.hpp
+* @brief   Process wide registry of runtime counters
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __METRICS_REGISTRY_HPP_INCLUDED
+#define __METRICS_REGISTRY_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error metrics_registry.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+struct metric_sample {
+	std::string name;  // "<source>.<metric>"
+	uint64_t value;
+	bool counter;      // Only ever grows: the registry derives a rate
+	double rate;       // Per second since the previous snapshot, counters only
+};
+
+typedef std::vector<metric_sample> metric_samples_t;
+
+
+/*************************************************************************//**
+**
+** Anything reporting metrics: registers itself with the registry and
+** unregisters before going away. report_metrics() is called from the thread
+** taking the snapshot, without locking, so that the owner never pays for
+** the reports: the owner updates what it reports with relaxed atomic stores
+** of word sized values (no tearing on 32 bit targets), report_metrics()
+** reads them with relaxed atomic loads. Values are read one by one, those of
+** a snapshot may thus be a few updates apart.
+**
+*****************************************************************************/
+
+class MetricsSource
+{
+public:
+	virtual ~MetricsSource() {}
+
+	virtual std::string get_metrics_name() const = 0;
+	virtual void report_metrics(metric_samples_t & out) const = 0;
+
+protected:
+	static void add_gauge(metric_samples_t & out, std::string const & name, uint64_t value);
+	static void add_counter(metric_samples_t & out, std::string const & name, uint64_t value);
+};
+
+
+/*************************************************************************//**
+**
+** The registry only keeps the sources and the counter values seen by the
+** previous snapshot, to compute rates. Thread safe.
+**
+*****************************************************************************/
+
+class MetricsRegistry
+{
+public:
+	static MetricsRegistry & instance();
+
+	void add_source(MetricsSource * source);
+	void rem_source(MetricsSource * source);
+
+	/**
+	 * Metrics of all the sources, names prefixed by the source name
+	 */
+	void snapshot(metric_samples_t & out);
+	/**
+	 * Log a snapshot, at verbosity 1
+	 */
+	void dump();
+
+private:
+	MetricsRegistry();
+	MetricsRegistry(MetricsRegistry const &);
+	MetricsRegistry & operator=(MetricsRegistry const &);
+
+	typedef std::pair<MetricsSource const *, std::string> counter_key_t;
+
+private:
+	pthread_mutex_t mutex;
+	std::vector<MetricsSource *> sources;
+	std::map<counter_key_t, uint64_t> last_counters;
+	struct timespec last_time;
+};
+
+
+/****************************************************************************/
+
+#endif /* __METRICS_REGISTRY_HPP_INCLUDED */
+/* EOF */
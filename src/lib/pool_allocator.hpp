@@ -33,52 +33,144 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <new>
+#include <memory>
+#include <utility>
 #include <logging.hpp>
 
 
+// Per object trace: the verbosity check alone takes the logger lock
+// #define _POOL_TRACE
+// Counters reported by get_pool_stats() and the metrics registry
+// #define _POOL_STATS
+// Free slabs poisoned, releases checked: double free, foreign pointers,
+// slabs written after release, objects leaked
+// #define _POOL_DEBUG
+// Both change the class layout: define them for the whole build
+// (ADD_DEFINITIONS), not in some sources only.
+
+#ifdef _POOL_STATS
+#include "metrics_registry.hpp"
+#endif
+
+#define POOL_CACHE_LINE      64
+#define POOL_HUGE_PAGE_SIZE  (2UL * 1024 * 1024)
+#define POOL_POISON_BYTE     0xdd
+
+
+struct pool_stats {
+	uint32_t size;        // Slabs
+	uint32_t usage;       // Objects allocated
+	uint32_t high_water;  // Highest usage
+	uint64_t allocs;      // Since creation
+	uint64_t frees;
+	uint64_t failures;    // Allocations failed: the pool could not grow
+};
+
+
 /*************************************************************************//**
 **
+** Slabs are sizeof(T) bytes, rounded up to a multiple of @a ALIGN when
+** given: with ALIGN = POOL_CACHE_LINE objects updated by different
+** threads never share a cache line. Chunks always start on a cache line,
+** so that the first and last slabs don't share one with unrelated heap
+** data either.
+**
+** By default chunks come from the heap. With POOL_HUGE_PAGES, chunks of
+** half a huge page or more are mapped on huge pages (MAP_HUGETLB), falling
+** back to transparent huge pages when none is reserved; with a NUMA node,
+** chunks are mapped and bound to that node. Otherwise pages land on the
+** node of the thread that first touches them: the one growing the pool,
+** which initializes the free list. Pools of a reactor created on its own
+** thread (see SocketServerGroup) thus stay local to it.
+**
+** Without _POOL_STATS and _POOL_DEBUG, allocations and releases do not
+** count anything beyond the usage, nor check anything.
+**
 */
-template <class T>
+template <class T, size_t ALIGN = 0>
 class PoolAllocator
 {
 public:
-	PoolAllocator(size_t slab_count):
+	enum placement_flags {
+		POOL_HUGE_PAGES = (1 << 0)
+	};
+
+	PoolAllocator(size_t slab_count, uint32_t flags = 0, int node = -1):
 		supplied_buffer(false),
-		slab_size(sizeof(T)),
-		slab_count(slab_count),
+		slab_size(aligned_size(sizeof(T))),
+		slab_count(0),
 		alloc_count(0),
 		slabs(0),
+		chunks(0),
+		last_chunk(0),
+		idle_chunks(0),
+		placement(flags),
+		numa_node(node),
 		_head(0),
-		_tail(0)
+		_tail(0),
+		pool_name("pool")
 	{
+		init_stats();
 		// It does not make sense to use a pool allocator for a
 		// small type, but let's check for minimal size anyway...
 		if (slab_size < sizeof(void *))
-			slab_size = sizeof(void *);
+			slab_size = aligned_size(sizeof(void *));
+		slab_shift = shift_of(slab_size);
 		
-		block_allocate();
-		init_free_list();
+		block_allocate(slab_count);
+		dump_free_list();
 	}
 	
+	/**
+	 * @a storage must hold @a slab_count slabs of get_slab_size() bytes,
+	 * aligned as the objects
+	 */
 	PoolAllocator(void * storage, size_t slab_count):
 		supplied_buffer(true),
-		slab_size(sizeof(T)),
-		slab_count(slab_count),
+		slab_size(aligned_size(sizeof(T))),
+		slab_count(0),
 		alloc_count(0),
 		slabs(storage),
+		chunks(0),
+		last_chunk(0),
+		idle_chunks(0),
+		placement(0),
+		numa_node(-1),
 		_head(0),
-		_tail(0)
+		_tail(0),
+		pool_name("pool")
 	{
+		init_stats();
 		// Don't check for minimal size, since if you
 		// use this constructor, you shall know what to do.
-		init_free_list();
+		slab_shift = shift_of(slab_size);
+		link_chunk(storage, slab_count, true);
+		dump_free_list();
 	}
 	
 	virtual ~PoolAllocator() {
-		if ((!supplied_buffer) && (slabs != 0))
-			free_mem(slabs);
+#ifdef _POOL_STATS
+		MetricsRegistry::instance().rem_source(&metrics);
+#endif
+#ifdef _POOL_DEBUG
+		if (alloc_count != 0) {
+			CLOG(WARNING, "memory") << pool_name << " destroyed with " << alloc_count << " objects allocated";
+			for (T * p = get_first(); p != 0; p = get_next(p))
+				CVLOG(1, "memory") << "\tleaked @" << p;
+		}
+#endif
+		while (chunks != 0) {
+			pool_chunk * const next = chunks->next;
+			if (!chunks->supplied)
+				free_mem(chunks->base, chunks->count * slab_size);
+			free(chunks);
+			chunks = next;
+		}
 	}
 	
 	void dump_free_list()
@@ -92,33 +184,71 @@ public:
 		}
 	}
 	
-	T * alloc_object() {
+	/**
+	 * Construct an object in place from @a args
+	 * @return 0 if the pool is exhausted and could not grow
+	 */
+	template <typename... Args>
+	T * emplace(Args &&... args) {
 		void * p = _head;
 		if (p == 0) {
 			grow_pool();
 			p = _head;
 		}
 		if (p != 0) {
+#ifdef _POOL_DEBUG
+			check_free_slab(p);
+#endif
 			if (_head == _tail)
 				_tail = _head = *((void **)_head);
 			else
 				_head = *((void **)_head);
+#ifdef _POOL_TRACE
 			CVLOG(2, "memory") << "allocated @" << p;
-			alloc_count++;
-			return new (p) T();
+#endif
+			publish(alloc_count, alloc_count + 1);
+			pool_chunk * const c = find_chunk(p);
+			set_live(c, p);
+			if ((c->used++ == 0) && is_releasable(c))
+				idle_chunks--;
+#ifdef _POOL_STATS
+			publish(stats.allocs, stats.allocs + 1);
+			if (alloc_count > stats.high_water)
+				publish(stats.high_water, alloc_count);
+#endif
+			return new (p) T(std::forward<Args>(args)...);
 		}
+#ifdef _POOL_STATS
+		publish(stats.failures, stats.failures + 1);
+#endif
 		return 0;
-	};
+	}
+
+	T * alloc_object() {
+		return emplace();
+	}
 
 	void free_object(T * ptr) {
 		if (ptr == 0)
 			return;
+#ifdef _POOL_DEBUG
+		if (check_release(ptr) != 0)
+			return;
+#endif
 		ptr->~T();
-		alloc_count--;
+		publish(alloc_count, alloc_count - 1);
+		pool_chunk * const c = find_chunk(ptr);
+		if (c != 0) {
+			clear_live(c, ptr);
+			if ((--c->used == 0) && is_releasable(c))
+				idle_chunks++;
+		}
 #ifdef _STACK_FREE
 		// Add released block on list head (stack behaviour)
 		*((void **)ptr) = _head;
 		_head = ptr;
+		if (_tail == 0)
+			_tail = ptr;
 #else /*_QUEUE_FREE */
 		// Add released block on list tail (queue behaviour)
 		*((void **)ptr) = 0;
@@ -129,25 +259,98 @@ public:
 			_tail = ptr;
 		}
 #endif
+#ifdef _POOL_DEBUG
+		poison(ptr);
+#endif
+#ifdef _POOL_TRACE
 		CVLOG(2, "memory") << "released @" << ptr;
+#endif
 		trim_pool();
 	};
+
+	/**
+	 * Owning handle giving the object back to its pool when destroyed
+	 */
+	struct deleter {
+		deleter(PoolAllocator * const p = 0):
+			pool(p)
+		{}
+		void operator()(T * const ptr) const {
+			pool->free_object(ptr);
+		}
+		PoolAllocator * pool;
+	};
+	typedef std::unique_ptr<T, deleter> unique_handle;
+
+	template <typename... Args>
+	unique_handle emplace_unique(Args &&... args) {
+		return unique_handle(emplace(std::forward<Args>(args)...), deleter(this));
+	}
 	
+	/**
+	 * Callable from any thread, e.g. by a metrics source
+	 */
 	uint32_t get_pool_size() const {
-		return slab_count;
+		return __atomic_load_n(&slab_count, __ATOMIC_RELAXED);
 	}
 	uint32_t get_pool_usage() const {
-		return alloc_count;
+		return __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+	}
+	size_t get_slab_size() const {
+		return slab_size;
+	}
+
+	/**
+	 * Counters are 0 when built without _POOL_STATS. Callable from any
+	 * thread: the values are read one by one, and may then be a few
+	 * allocations apart.
+	 * @return 0 on success, -1 if @a out is null
+	 */
+	int get_pool_stats(pool_stats * const out) const {
+		if (out == 0)
+			return -1;
+		memset(out, 0, sizeof(*out));
+		out->size = get_pool_size();
+		out->usage = get_pool_usage();
+#ifdef _POOL_STATS
+		out->high_water = __atomic_load_n(&stats.high_water, __ATOMIC_RELAXED);
+		out->allocs = __atomic_load_n(&stats.allocs, __ATOMIC_RELAXED);
+		out->failures = __atomic_load_n(&stats.failures, __ATOMIC_RELAXED);
+		// Every object allocated is either freed or still in use
+		if (out->allocs > out->usage)
+			out->frees = out->allocs - out->usage;
+#endif
+		return 0;
+	}
+
+	/**
+	 * Name in logs and metrics: @a name is not copied
+	 */
+	void set_pool_name(char const * const name) {
+		pool_name = name;
+	}
+	char const * get_pool_name() const {
+		return pool_name;
 	}
 
 
 protected:
 	virtual void * alloc_mem(size_t const msize) {
-		void * const ptr = calloc(1, msize);
+		if ((placement & POOL_HUGE_PAGES) || (numa_node >= 0))
+			return map_mem(msize);
+		void * ptr;
+		if (posix_memalign(&ptr, chunk_alignment(), msize) != 0)
+			return 0;
+		memset(ptr, 0, msize);
 		CVLOG(2, "memory") << "allocated heap memory @" << ptr << " size:" << msize;
 		return ptr;
 	}
-	virtual void free_mem(void * const ptr) {
+	virtual void free_mem(void * const ptr, size_t const msize) {
+		if ((placement & POOL_HUGE_PAGES) || (numa_node >= 0)) {
+			CVLOG(2, "memory") << "unmapping memory @" << ptr;
+			munmap(ptr, map_length(msize));
+			return;
+		}
 		CVLOG(2, "memory") << "releasing heap memory @" << ptr;
 		free(ptr);
 	}
@@ -157,47 +360,416 @@ protected:
 	virtual void trim_pool() {
 	}
 	
+	/**
+	 * Add a new chunk of @a count slabs to the pool. Slabs already handed
+	 * out are never moved, so pointers to live objects stay valid.
+	 * @return 0 on success, -1 if memory could not be allocated
+	 */
+	int add_chunk(size_t const count) {
+		if (count == 0)
+			return -1;
+		void * const base = alloc_mem(count * slab_size);
+		if (base == 0)
+			return -1;
+		if (link_chunk(base, count, false) != 0) {
+			free_mem(base, count * slab_size);
+			return -1;
+		}
+		CVLOG(2, "memory") << "pool grown by " << count << " slabs, size:" << slab_count;
+		return 0;
+	}
+	
+	/**
+	 * Default trimming policy: once usage has dropped below a quarter of
+	 * the capacity, give the chunks left without objects back to the
+	 * system, but the largest one. With the pools doubling in size, the
+	 * gap between the two thresholds and the spare chunk keep a load
+	 * going up and down (down to nothing, even) from releasing and adding
+	 * a chunk over and over.
+	 */
+	void trim_idle_chunks() {
+		if ((idle_chunks < 2) || (alloc_count >= slab_count / 4))
+			return;
+		pool_chunk const * spare = 0;
+		for (pool_chunk const * c = chunks; c != 0; c = c->next)
+			if (is_idle(c, 0) && ((spare == 0) || (c->count > spare->count)))
+				spare = c;
+		release_idle_chunks(spare);
+	}
+
+	/**
+	 * Free the chunks whose slabs are all free, except the first one and
+	 * supplied storage. Objects are never moved: a chunk holding a single
+	 * live object stays. Freeing objects while iterating with get_first()
+	 * / get_next() may thus end the iteration early.
+	 * @a spare: idle chunk to keep
+	 * @return number of slabs released
+	 */
+	size_t release_idle_chunks(void const * const spare = 0) {
+		if (idle_chunks == 0)
+			return 0;
+
+		// Drop the slabs of the idle chunks from the free list, keeping the
+		// order of the others
+		void * head = 0;
+		void * tail = 0;
+		for (void * p = _head; p != 0; ) {
+			void * const next = *((void **)p);
+			if (!is_idle(find_chunk(p), spare)) {
+				if (tail == 0)
+					head = p;
+				else
+					*((void **)tail) = p;
+				tail = p;
+			}
+			p = next;
+		}
+		if (tail != 0)
+			*((void **)tail) = 0;
+		_head = head;
+		_tail = tail;
+
+		size_t released = 0;
+		pool_chunk ** pp = &chunks;
+		while (*pp != 0) {
+			pool_chunk * const c = *pp;
+			if (is_idle(c, spare)) {
+				*pp = c->next;
+				publish(slab_count, slab_count - c->count);
+				released += c->count;
+				free_mem(c->base, c->count * slab_size);
+				if (c == last_chunk)
+					last_chunk = 0;
+				free(c);
+			} else
+				pp = &c->next;
+		}
+		idle_chunks = (spare != 0) ? 1 : 0;
+		CVLOG(2, "memory") << "pool trimmed by " << released << " slabs, size:" << slab_count;
+		return released;
+	}
+
+	/**
+	 * Iterate over the allocated objects only, skipping free slabs a
+	 * bitmap word at a time. The object returned may be freed before
+	 * moving on, as long as get_next() is then given its address.
+	 */
 	T * get_first() const {
-		return reinterpret_cast<T*>(slabs);
+		return first_live(chunks, 0);
 	}
 	T * get_next(T * const p) const {
-		T * const limit = get_first() + slab_count;
-		T * next = p + 1;
-		if (next >= limit)
+		pool_chunk * const c = find_chunk(p);
+		if (c == 0)
 			return 0;
-		return next;
+		return first_live(c, slot_of(c, p) + 1);
 	}
 
 
 private:
-	void block_allocate() {
-		if (slabs == 0)
-			slabs = alloc_mem(slab_count * slab_size);
-	}
-
-	void init_free_list() {
-		void ** pred;
-		alloc_count = 0;
-		_head = slabs;
-		pred = (void **)slabs;
-		for (unsigned i=1; i < slab_count; i++) {
-			void ** curr = (void**)((uint8_t*)slabs + (i * slab_size));
-			*curr = 0;
+	/**
+	 * Update of a value only the owner thread writes, but other threads
+	 * read (see get_pool_stats()): a relaxed atomic store is a plain store
+	 * that never tears.
+	 */
+	template <typename V>
+	static void publish(V & var, V const value) {
+		__atomic_store_n(&var, value, __ATOMIC_RELAXED);
+	}
+
+#ifdef _POOL_STATS
+	// Word sized: lock free atomics on 32 bit targets as well, where a
+	// 64 bit counter would tear (ARMv5 has no 64 bit atomic access)
+	struct pool_counters {
+		uint32_t high_water;
+		unsigned long allocs;
+		unsigned long failures;
+	};
+
+	class metrics_source : public MetricsSource {
+	public:
+		metrics_source():
+			pool(0)
+		{}
+		std::string get_metrics_name() const {
+			return pool->pool_name;
+		}
+		void report_metrics(metric_samples_t & out) const {
+			pool_stats st;
+			pool->get_pool_stats(&st);
+			add_gauge(out, "size", st.size);
+			add_gauge(out, "usage", st.usage);
+			add_gauge(out, "high_water", st.high_water);
+			add_counter(out, "allocs", st.allocs);
+			add_counter(out, "frees", st.frees);
+			add_counter(out, "failures", st.failures);
+		}
+		PoolAllocator const * pool;
+	};
+#endif
+
+	void init_stats() {
+#ifdef _POOL_STATS
+		memset(&stats, 0, sizeof(stats));
+		metrics.pool = this;
+		MetricsRegistry::instance().add_source(&metrics);
+#endif
+	}
+
+#ifdef _POOL_DEBUG
+	void poison(void * const p) const {
+		memset((uint8_t *)p + sizeof(void *), POOL_POISON_BYTE, slab_size - sizeof(void *));
+	}
+
+	/**
+	 * A free slab must still hold the poison, and link to another slab of
+	 * the pool. A broken link drops the rest of the free list: the pool
+	 * grows instead of handing out foreign memory.
+	 */
+	void check_free_slab(void * const p) {
+		uint8_t const * const b = (uint8_t const *)p;
+		for (size_t i = sizeof(void *); i < slab_size; i++)
+			if (b[i] != POOL_POISON_BYTE) {
+				CLOG(ERROR, "memory") << pool_name << " slab @" << p << " written after release, offset " << i;
+				break;
+			}
+		void * const next = *((void **)p);
+		if ((next != 0) && (find_chunk(next) == 0)) {
+			CLOG(ERROR, "memory") << pool_name << " slab @" << p << " free link overwritten: " << next;
+			*((void **)p) = 0;
+			_tail = p;
+		}
+	}
+
+	/**
+	 * @return 0 if @a ptr is an object of this pool, -1 otherwise: it is
+	 *         then left alone
+	 */
+	int check_release(void const * const ptr) const {
+		pool_chunk const * const c = find_chunk(ptr);
+		if (c == 0) {
+			CLOG(ERROR, "memory") << pool_name << " release of @" << ptr << ": not from this pool";
+			return -1;
+		}
+		if (((uint8_t *)ptr - (uint8_t *)c->base) % slab_size != 0) {
+			CLOG(ERROR, "memory") << pool_name << " release of @" << ptr << ": inside a slab";
+			return -1;
+		}
+		if (!is_live(c, ptr)) {
+			CLOG(ERROR, "memory") << pool_name << " double free of @" << ptr;
+			return -1;
+		}
+		return 0;
+	}
+#endif
+
+	static size_t aligned_size(size_t const size) {
+		size_t const align = (ALIGN > __alignof__(T)) ? ALIGN : __alignof__(T);
+		return (size + align - 1) / align * align;
+	}
+
+	static size_t chunk_alignment() {
+		return (ALIGN > POOL_CACHE_LINE) ? ALIGN : POOL_CACHE_LINE;
+	}
+
+	/**
+	 * Mapped chunk length: whole huge pages when the chunk is worth them
+	 */
+	size_t map_length(size_t const msize) const {
+		size_t const page = ((placement & POOL_HUGE_PAGES) && (msize >= POOL_HUGE_PAGE_SIZE / 2)) ?
+							POOL_HUGE_PAGE_SIZE : sysconf(_SC_PAGESIZE);
+		return (msize + page - 1) / page * page;
+	}
+
+	void * map_mem(size_t const msize) {
+		size_t const length = map_length(msize);
+		void * ptr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		if ((placement & POOL_HUGE_PAGES) && (length % POOL_HUGE_PAGE_SIZE == 0))
+			ptr = mmap(0, length, PROT_READ | PROT_WRITE,
+					   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		if (ptr == MAP_FAILED) {
+			ptr = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (ptr == MAP_FAILED) {
+				CLOG(ERROR, "memory") << "cannot map " << length << " bytes";
+				return 0;
+			}
+#ifdef MADV_HUGEPAGE
+			if (placement & POOL_HUGE_PAGES)
+				madvise(ptr, length, MADV_HUGEPAGE);
+#endif
+		}
+#ifdef SYS_mbind
+		// Before any page is touched; preferred so that an exhausted node
+		// still gets memory from the others
+		if ((numa_node >= 0) && (numa_node < (int)(sizeof(unsigned long) * 8))) {
+			unsigned long const mask = 1UL << numa_node;
+			if (syscall(SYS_mbind, ptr, length, MPOL_PREFERRED_MODE, &mask, sizeof(mask) * 8, 0) != 0)
+				CLOG(WARNING, "memory") << "cannot bind " << length << " bytes to node " << numa_node;
+		}
+#endif
+		CVLOG(2, "memory") << "mapped memory @" << ptr << " size:" << length;
+		return ptr;
+	}
+
+	static const int MPOL_PREFERRED_MODE = 1; // linux/mempolicy.h
+
+	struct pool_chunk {
+		pool_chunk * next;
+		void * base;
+		uint32_t count;
+		uint32_t used;
+		bool supplied;
+		uint64_t live[1]; // Occupancy bitmap, allocated with the chunk
+	};
+
+	static size_t bitmap_words(size_t const count) {
+		return (count + 63) / 64;
+	}
+
+	static unsigned shift_of(size_t const size) {
+		return ((size & (size - 1)) == 0) ? __builtin_ctzl(size) : 0;
+	}
+
+	uint32_t slot_of(pool_chunk const * const c, void const * const p) const {
+		size_t const offset = (uint8_t *)p - (uint8_t *)c->base;
+		return slab_shift ? (offset >> slab_shift) : (offset / slab_size);
+	}
+
+	void set_live(pool_chunk * const c, void const * const p) {
+		uint32_t const i = slot_of(c, p);
+		c->live[i / 64] |= 1ULL << (i % 64);
+	}
+
+	void clear_live(pool_chunk * const c, void const * const p) {
+		uint32_t const i = slot_of(c, p);
+		c->live[i / 64] &= ~(1ULL << (i % 64));
+	}
+
+	bool is_live(pool_chunk const * const c, void const * const p) const {
+		uint32_t const i = slot_of(c, p);
+		return (c->live[i / 64] & (1ULL << (i % 64))) != 0;
+	}
+
+	/**
+	 * First allocated object at or after slot @a from of chunk @a c, then
+	 * in the following chunks
+	 */
+	T * first_live(pool_chunk const * c, uint32_t from) const {
+		for ( ; c != 0; c = c->next, from = 0) {
+			size_t const words = bitmap_words(c->count);
+			for (size_t w = from / 64; (from < c->count) && (w < words); w++) {
+				uint64_t bits = c->live[w];
+				if (w == from / 64)
+					bits &= ~0ULL << (from % 64);
+				if (bits != 0)
+					return reinterpret_cast<T*>((uint8_t *)c->base +
+								(w * 64 + __builtin_ctzll(bits)) * slab_size);
+			}
+		}
+		return 0;
+	}
+
+	bool is_releasable(pool_chunk const * const c) const {
+		return (c != chunks) && !c->supplied;
+	}
+
+	bool is_idle(pool_chunk const * const c, void const * const spare) const {
+		return (c->used == 0) && is_releasable(c) && ((void const *)c != spare);
+	}
+
+	uint8_t * chunk_limit(pool_chunk const * const c) const {
+		return (uint8_t *)c->base + (c->count * slab_size);
+	}
+
+	bool in_chunk(pool_chunk const * const c, void const * const p) const {
+		return ((uint8_t *)p >= (uint8_t *)c->base) && ((uint8_t *)p < chunk_limit(c));
+	}
+
+	/**
+	 * Consecutive allocations and releases mostly hit the same chunk:
+	 * try the last one found first
+	 */
+	pool_chunk * find_chunk(void const * const p) const {
+		if ((last_chunk != 0) && in_chunk(last_chunk, p))
+			return last_chunk;
+		for (pool_chunk * c = chunks; c != 0; c = c->next)
+			if (in_chunk(c, p)) {
+				last_chunk = c;
+				return c;
+			}
+		return 0;
+	}
+
+	void block_allocate(size_t const count) {
+		if (slabs != 0)
+			return;
+		slabs = alloc_mem(count * slab_size);
+		if (slabs != 0)
+			link_chunk(slabs, count, false);
+	}
+
+	int link_chunk(void * const base, size_t const count, bool const supplied) {
+		pool_chunk * const c = (pool_chunk *)calloc(1, sizeof(pool_chunk) +
+									bitmap_words(count) * sizeof(uint64_t));
+		if (c == 0)
+			return -1;
+		c->base = base;
+		c->count = count;
+		c->supplied = supplied;
+		// Chunks are kept in allocation order so that iteration
+		// visits older (usually busier) slabs first
+		pool_chunk ** pp = &chunks;
+		while (*pp != 0)
+			pp = &(*pp)->next;
+		*pp = c;
+		if (is_releasable(c))
+			idle_chunks++;
+		publish(slab_count, (uint32_t)(slab_count + count));
+		init_free_list(base, count);
+		return 0;
+	}
+
+	void init_free_list(void * const base, size_t const count) {
+		if (count == 0)
+			return;
+#ifdef _POOL_DEBUG
+		memset(base, POOL_POISON_BYTE, count * slab_size);
+#endif
+		void ** pred = (void **)base;
+		for (unsigned i=1; i < count; i++) {
+			void ** curr = (void**)((uint8_t*)base + (i * slab_size));
 			*pred = curr;
-			_tail = pred;
 			pred = curr;
 		}
-		dump_free_list();
+		*pred = 0;
+		// Append the new slabs to the free list
+		if (_tail == 0)
+			_head = base;
+		else
+			*((void **)_tail) = base;
+		_tail = pred;
 	}
 
 private:
 	bool supplied_buffer;
 	size_t slab_size;
+	unsigned slab_shift; // log2(slab_size), 0 if not a power of two
 	uint32_t slab_count;
 	uint32_t alloc_count;
 	void *slabs;
+	pool_chunk *chunks;
+	mutable pool_chunk *last_chunk;
+	uint32_t idle_chunks; // Releasable chunks without objects
+	uint32_t placement;
+	int numa_node;
 	void *_head;
 	void *_tail;
+	char const *pool_name;
+#ifdef _POOL_STATS
+	pool_counters stats;
+	metrics_source metrics;
+#endif
 };
 
 /****************************************************************************/
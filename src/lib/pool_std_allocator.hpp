@@ -0,0 +1,162 @@
+/**
+******************************************************************************
+* @file    pool_std_allocator.hpp
+* @brief   Standard allocator drawing container nodes from pools
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __POOL_STD_ALLOCATOR_HPP_INCLUDED
+#define __POOL_STD_ALLOCATOR_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error pool_std_allocator.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "concurrent_pool_allocator.hpp"
+
+
+/*************************************************************************//**
+** One pool per node size and alignment, whatever the node type
+*/
+template <size_t SIZE, size_t ALIGN>
+class PoolNodeSource
+{
+public:
+	// Raw storage: the container constructs the element itself
+	struct node {
+		typename std::aligned_storage<SIZE, ALIGN>::type data;
+	};
+
+	static const size_t NODES_PER_CHUNK = 64;
+
+	static ConcurrentPoolAllocator<node> * get() {
+		static ConcurrentPoolAllocator<node> * const pool =
+			new ConcurrentPoolAllocator<node>(NODES_PER_CHUNK);
+		return pool;
+	}
+};
+
+
+/*************************************************************************//**
+**
+** Allocator for node based containers (std::list, std::map, std::set):
+** single element allocations, i.e. the nodes, come from a pool shared by
+** all the containers whose nodes have the same size and alignment;
+** anything else (vectors, strings) goes to the global heap.
+**
+** The pools are ConcurrentPoolAllocator instances: a container may be
+** built on one thread and destroyed on another. They are created on first
+** use and never deleted, so that containers in static objects can still
+** release their nodes at exit. The allocator itself is stateless.
+**
+*****************************************************************************/
+
+template <class U>
+class PoolStdAllocator
+{
+public:
+	typedef U value_type;
+	typedef U * pointer;
+	typedef U const * const_pointer;
+	typedef U & reference;
+	typedef U const & const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+
+	template <class V>
+	struct rebind {
+		typedef PoolStdAllocator<V> other;
+	};
+
+	PoolStdAllocator() {
+	}
+	template <class V>
+	PoolStdAllocator(PoolStdAllocator<V> const &) {
+	}
+
+	pointer allocate(size_type const n, void const * = 0) {
+		if (n == 1) {
+			node * const p = node_pool()->alloc_object();
+			if (p == 0)
+				throw std::bad_alloc();
+			return reinterpret_cast<pointer>(p);
+		}
+		return static_cast<pointer>(::operator new(n * sizeof(U)));
+	}
+
+	void deallocate(pointer const p, size_type const n) {
+		if (n == 1)
+			node_pool()->free_object(reinterpret_cast<node *>(p));
+		else
+			::operator delete(p);
+	}
+
+	size_type max_size() const {
+		return size_type(-1) / sizeof(U);
+	}
+
+	pointer address(reference x) const {
+		return &x;
+	}
+	const_pointer address(const_reference x) const {
+		return &x;
+	}
+
+	template <class V, typename... Args>
+	void construct(V * const p, Args &&... args) {
+		new ((void *)p) V(std::forward<Args>(args)...);
+	}
+	template <class V>
+	void destroy(V * const p) {
+		p->~V();
+	}
+
+private:
+	typedef PoolNodeSource<sizeof(U), __alignof__(U)> source;
+	typedef typename source::node node;
+
+	static ConcurrentPoolAllocator<node> * node_pool() {
+		return source::get();
+	}
+};
+
+
+template <class U, class V>
+inline bool operator==(PoolStdAllocator<U> const &, PoolStdAllocator<V> const &)
+{
+	return true;
+}
+
+template <class U, class V>
+inline bool operator!=(PoolStdAllocator<U> const &, PoolStdAllocator<V> const &)
+{
+	return false;
+}
+
+
+/****************************************************************************/
+
+#endif /* __POOL_STD_ALLOCATOR_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,214 @@
+/**
+******************************************************************************
+* @file    ring_buffer.hpp
+* @brief   Byte ring buffer over pooled fixed-size storage blocks
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __RINGBUFFER_HPP_INCLUDED
+#define __RINGBUFFER_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error ring_buffer.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <pool_allocator.hpp>
+
+
+/*************************************************************************//**
+** Storage block for socket buffers. The size is a power of two, so that
+** ring indexes wrap with a simple mask.
+*/
+static const uint32_t SOCKET_BUFFER_SIZE = 4096;
+
+struct socket_buffer {
+	uint8_t data[SOCKET_BUFFER_SIZE];
+};
+
+class SocketBufferPool : public PoolAllocator<socket_buffer>
+{
+public:
+	SocketBufferPool(size_t const slab_count):
+		PoolAllocator<socket_buffer>(slab_count)
+	{
+		set_pool_name("socket buffers");
+	}
+
+protected:
+	// Blocks are lent to connections while they hold data: grow in
+	// chunks instead of failing when all of them are in use, and give
+	// the chunks back once a burst is over
+	void grow_pool() {
+		add_chunk(get_pool_size() ? get_pool_size() : 4);
+	}
+	void trim_pool() {
+		trim_idle_chunks();
+	}
+};
+
+
+/*************************************************************************//**
+** Single producer, single consumer byte FIFO. Read and write positions are
+** free running counters: their difference is the amount of stored data.
+*/
+class RingBuffer
+{
+public:
+	RingBuffer():
+		storage(0),
+		capacity(0),
+		rd_pos(0),
+		wr_pos(0)
+	{}
+
+	void attach(uint8_t * const mem, uint32_t const size) {
+		storage = mem;
+		capacity = size;
+		rd_pos = wr_pos = 0;
+	}
+	uint8_t * detach() {
+		uint8_t * const mem = storage;
+		storage = 0;
+		capacity = 0;
+		rd_pos = wr_pos = 0;
+		return mem;
+	}
+	bool is_attached() const {
+		return storage != 0;
+	}
+
+	uint32_t size() const {
+		return wr_pos - rd_pos;
+	}
+	uint32_t space() const {
+		return capacity - size();
+	}
+	bool empty() const {
+		return wr_pos == rd_pos;
+	}
+	bool full() const {
+		return size() == capacity;
+	}
+
+	/**
+	 * Copy up to @a len bytes into the buffer
+	 * @return the number of bytes actually stored
+	 */
+	uint32_t write(const void * const src, uint32_t len) {
+		struct iovec iov[2];
+		int const cnt = get_write_iov(iov);
+		uint32_t done = 0;
+		for (int i = 0; (i < cnt) && (done < len); i++) {
+			uint32_t const n = (len - done < iov[i].iov_len) ? len - done : iov[i].iov_len;
+			memcpy(iov[i].iov_base, (const uint8_t *)src + done, n);
+			done += n;
+		}
+		commit(done);
+		return done;
+	}
+
+	/**
+	 * Copy up to @a len bytes out of the buffer without consuming them
+	 * @return the number of bytes copied
+	 */
+	uint32_t peek(void * const dst, uint32_t len) const {
+		struct iovec iov[2];
+		int const cnt = get_read_iov(iov);
+		uint32_t done = 0;
+		for (int i = 0; (i < cnt) && (done < len); i++) {
+			uint32_t const n = (len - done < iov[i].iov_len) ? len - done : iov[i].iov_len;
+			memcpy((uint8_t *)dst + done, iov[i].iov_base, n);
+			done += n;
+		}
+		return done;
+	}
+
+	uint32_t read(void * const dst, uint32_t const len) {
+		uint32_t const n = peek(dst, len);
+		consume(n);
+		return n;
+	}
+
+	/**
+	 * Contiguous readable bytes starting at the read position
+	 */
+	const uint8_t * read_ptr(uint32_t &len) const {
+		uint32_t const off = rd_pos & (capacity - 1);
+		uint32_t const avail = size();
+		len = (avail < capacity - off) ? avail : capacity - off;
+		return storage + off;
+	}
+
+	/**
+	 * Describe stored data (up to two segments) for writev/sendmsg
+	 * @return number of segments filled
+	 */
+	int get_read_iov(struct iovec iov[2]) const {
+		return get_iov(iov, rd_pos, size());
+	}
+	/**
+	 * Describe free space (up to two segments) for readv/recvmsg
+	 * @return number of segments filled
+	 */
+	int get_write_iov(struct iovec iov[2]) const {
+		return get_iov(iov, wr_pos, space());
+	}
+
+	void consume(uint32_t const n) {
+		rd_pos += n;
+		// Restart from offset 0 whenever possible: keeps data contiguous
+		if (rd_pos == wr_pos)
+			rd_pos = wr_pos = 0;
+	}
+	void commit(uint32_t const n) {
+		wr_pos += n;
+	}
+
+private:
+	int get_iov(struct iovec iov[2], uint32_t const pos, uint32_t const len) const {
+		if (len == 0)
+			return 0;
+		uint32_t const off = pos & (capacity - 1);
+		uint32_t const first = (len < capacity - off) ? len : capacity - off;
+		iov[0].iov_base = storage + off;
+		iov[0].iov_len = first;
+		if (first == len)
+			return 1;
+		iov[1].iov_base = storage;
+		iov[1].iov_len = len - first;
+		return 2;
+	}
+
+private:
+	uint8_t *storage;
+	uint32_t capacity;
+	uint32_t rd_pos;
+	uint32_t wr_pos;
+};
+
+
+/****************************************************************************/
+
+#endif /* __RINGBUFFER_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,396 @@
+/**
+******************************************************************************
+* @file    size_class_arena.cpp
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "size_class_arena.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+** Update of a counter only the owner writes, but get_stats() reads from
+** any thread: a relaxed atomic store is a plain store that never tears
+*/
+static inline void publish(unsigned long & var, unsigned long const value)
+{
+	__atomic_store_n(&var, value, __ATOMIC_RELAXED);
+}
+
+
+/*************************************************************************//**
+** Raw storage of one class: left uninitialized by the pool
+*/
+template <size_t SIZE>
+struct arena_block {
+	arena_block() {
+	}
+	uint8_t data[SIZE];
+};
+
+
+/*************************************************************************//**
+** Pool of one class. Grows by doubling, and gives its chunks back once
+** usage has fallen below a quarter (see PoolAllocator::trim_idle_chunks()).
+** Publishes its capacity to @a capacity each time it changes.
+*/
+template <size_t SIZE>
+class SizeClassArena::size_class_pool :
+	public SizeClassArena::size_class,
+	private PoolAllocator<arena_block<SIZE>, ARENA_ALIGN>
+{
+	typedef PoolAllocator<arena_block<SIZE>, ARENA_ALIGN> pool_t;
+
+public:
+	size_class_pool(unsigned long * const capacity):
+		pool_t((ARENA_CHUNK_BYTES / SIZE) ? (ARENA_CHUNK_BYTES / SIZE) : 1),
+		capacity(capacity)
+	{
+		snprintf(name, sizeof(name), "arena %u", (unsigned)SIZE);
+		this->set_pool_name(name);
+		publish(*capacity, this->get_pool_size());
+	}
+
+	void * alloc() {
+		return this->alloc_object();
+	}
+	void free(void * const ptr) {
+		this->free_object(static_cast<arena_block<SIZE> *>(ptr));
+	}
+
+protected:
+	void grow_pool() {
+		this->add_chunk(this->get_pool_size() ? this->get_pool_size() : 1);
+		publish(*capacity, this->get_pool_size());
+	}
+	void trim_pool() {
+		this->trim_idle_chunks();
+		publish(*capacity, this->get_pool_size());
+	}
+
+private:
+	unsigned long * capacity;
+	char name[16];
+};
+
+
+/*************************************************************************//**
+**
+*/
+SizeClassArena::SizeClassArena()
+{
+	memset(classes, 0, sizeof(classes));
+	memset(counters, 0, sizeof(counters));
+	MetricsRegistry::instance().add_source(this);
+}
+
+
+/*************************************************************************//**
+** Blocks still allocated go with their pools; large ones are leaked
+*/
+SizeClassArena::~SizeClassArena()
+{
+	MetricsRegistry::instance().rem_source(this);
+	if (counters[CLASS_COUNT].in_use != 0)
+		_WARNING() << "SizeClassArena @" << this << " " << counters[CLASS_COUNT].in_use << " large blocks not released";
+	for (unsigned i = 0; i < CLASS_COUNT; i++)
+		delete classes[i];
+}
+
+
+/*************************************************************************//**
+** CLASS_COUNT for sizes above the largest class
+*/
+unsigned SizeClassArena::class_of(size_t const size)
+{
+	if (size <= ((size_t)1 << MIN_SHIFT))
+		return 0;
+	if (size > MAX_BLOCK_SIZE)
+		return CLASS_COUNT;
+	// Bits needed for size - 1: rounds up to the next power of two
+	unsigned const bits = sizeof(unsigned long) * 8 - __builtin_clzl(size - 1);
+	return bits - MIN_SHIFT;
+}
+
+
+/*************************************************************************//**
+**
+*/
+size_t SizeClassArena::block_size(size_t const size)
+{
+	unsigned const cls = class_of(size);
+	return (cls < CLASS_COUNT) ? (size_t)1 << (MIN_SHIFT + cls) : size;
+}
+
+
+/*************************************************************************//**
+**
+*/
+SizeClassArena::size_class * SizeClassArena::get_class(unsigned const cls)
+{
+	if (classes[cls] != 0)
+		return classes[cls];
+
+	switch (cls + MIN_SHIFT) {
+	case 4:  classes[cls] = new size_class_pool<16>(&counters[cls].capacity);   break;
+	case 5:  classes[cls] = new size_class_pool<32>(&counters[cls].capacity);   break;
+	case 6:  classes[cls] = new size_class_pool<64>(&counters[cls].capacity);   break;
+	case 7:  classes[cls] = new size_class_pool<128>(&counters[cls].capacity);  break;
+	case 8:  classes[cls] = new size_class_pool<256>(&counters[cls].capacity);  break;
+	case 9:  classes[cls] = new size_class_pool<512>(&counters[cls].capacity);  break;
+	case 10: classes[cls] = new size_class_pool<1024>(&counters[cls].capacity); break;
+	case 11: classes[cls] = new size_class_pool<2048>(&counters[cls].capacity); break;
+	case 12: classes[cls] = new size_class_pool<4096>(&counters[cls].capacity); break;
+	default:
+		_ERROR() << "SizeClassArena no class " << cls;
+		break;
+	}
+	return classes[cls];
+}
+
+
+/*************************************************************************//**
+**
+*/
+void * SizeClassArena::allocate(size_t const size)
+{
+	if (size == 0)
+		return 0;
+
+	unsigned const cls = class_of(size);
+	class_counters * const st = &counters[cls];
+	void * ptr = 0;
+	if (cls < CLASS_COUNT) {
+		size_class * const c = get_class(cls);
+		if (c != 0)
+			ptr = c->alloc();
+	} else
+	if (posix_memalign(&ptr, ARENA_ALIGN, size) != 0)
+		ptr = 0;
+
+	if (ptr == 0) {
+		publish(st->failures, st->failures + 1);
+		_ERROR() << "SizeClassArena @" << this << " cannot allocate " << size << " bytes";
+		return 0;
+	}
+	publish(st->allocs, st->allocs + 1);
+	publish(st->requested, st->requested + size);
+	publish(st->in_use, st->in_use + 1);
+	if (st->in_use > st->peak)
+		publish(st->peak, st->in_use);
+	return ptr;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void SizeClassArena::release(void * const ptr, size_t const size)
+{
+	if (ptr == 0)
+		return;
+
+	unsigned const cls = class_of(size);
+	class_counters * const st = &counters[cls];
+	if (cls < CLASS_COUNT) {
+		if (classes[cls] == 0) {
+			_ERROR() << "SizeClassArena @" << this << " release of " << ptr << " to unused class " << cls;
+			return;
+		}
+		classes[cls]->free(ptr);
+	} else
+		free(ptr);
+
+	publish(st->in_use, st->in_use - 1);
+	publish(st->requested, st->requested - size);
+}
+
+
+/*************************************************************************//**
+**
+*/
+int SizeClassArena::get_stats(unsigned const cls, arena_class_stats * const out) const
+{
+	if ((cls > CLASS_COUNT) || (out == 0))
+		return -1;
+	class_counters const * const st = &counters[cls];
+	out->block_size = (cls < CLASS_COUNT) ? (size_t)1 << (MIN_SHIFT + cls) : 0;
+	out->in_use = __atomic_load_n(&st->in_use, __ATOMIC_RELAXED);
+	out->peak = __atomic_load_n(&st->peak, __ATOMIC_RELAXED);
+	out->requested = __atomic_load_n(&st->requested, __ATOMIC_RELAXED);
+	out->allocs = __atomic_load_n(&st->allocs, __ATOMIC_RELAXED);
+	out->failures = __atomic_load_n(&st->failures, __ATOMIC_RELAXED);
+	// Large blocks are held by nobody but their users
+	if (cls < CLASS_COUNT)
+		out->capacity = __atomic_load_n(&st->capacity, __ATOMIC_RELAXED);
+	else
+		out->capacity = out->in_use;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Internal fragmentation: bytes lost rounding the blocks in use up to
+** their class; free: bytes of the blocks the pool holds but nobody uses.
+** Counters are read one by one, possibly while the owner updates them:
+** differences are clamped at 0.
+*/
+void SizeClassArena::dump_stats() const
+{
+	for (unsigned i = 0; i <= CLASS_COUNT; i++) {
+		arena_class_stats st;
+		get_stats(i, &st);
+		if (st.allocs == 0)
+			continue;
+		uint64_t const held = (uint64_t)st.in_use * st.block_size;
+		uint64_t const frag = (st.block_size && (held > st.requested)) ? held - st.requested : 0;
+		uint32_t const idle = (st.capacity > st.in_use) ? st.capacity - st.in_use : 0;
+		size_t const size = st.block_size ? st.block_size : (size_t)MAX_BLOCK_SIZE;
+		_VBL(1) << "arena class " << size << (st.block_size ? "" : "+") <<
+			" in use:" << st.in_use << " peak:" << st.peak << " capacity:" << st.capacity <<
+			" allocs:" << st.allocs << " failures:" << st.failures <<
+			" internal frag:" << frag <<
+			" free:" << (uint64_t)idle * st.block_size;
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+std::string SizeClassArena::get_metrics_name() const
+{
+	return "arena";
+}
+
+
+/*************************************************************************//**
+** Classes never used are left out
+*/
+void SizeClassArena::report_metrics(metric_samples_t & out) const
+{
+	for (unsigned i = 0; i <= CLASS_COUNT; i++) {
+		arena_class_stats st;
+		get_stats(i, &st);
+		if (st.allocs == 0)
+			continue;
+		char prefix[16];
+		if (st.block_size)
+			snprintf(prefix, sizeof(prefix), "%u.", (unsigned)st.block_size);
+		else
+			snprintf(prefix, sizeof(prefix), "large.");
+		add_gauge(out, std::string(prefix) + "in_use", st.in_use);
+		add_gauge(out, std::string(prefix) + "peak", st.peak);
+		add_gauge(out, std::string(prefix) + "capacity", st.capacity);
+		add_counter(out, std::string(prefix) + "allocs", st.allocs);
+		add_counter(out, std::string(prefix) + "failures", st.failures);
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+ArenaRegion::ArenaRegion(SizeClassArena * const owner):
+	arena(owner),
+	blocks(0),
+	cursor(0),
+	limit(0),
+	used(0)
+{
+}
+
+
+/*************************************************************************//**
+**
+*/
+ArenaRegion::~ArenaRegion()
+{
+	reset();
+}
+
+
+/*************************************************************************//**
+**
+*/
+ArenaRegion::block * ArenaRegion::add_block(size_t const size)
+{
+	block * const b = static_cast<block *>(arena->allocate(size));
+	if (b == 0)
+		return 0;
+	b->next = blocks;
+	b->size = size;
+	blocks = b;
+	return b;
+}
+
+
+/*************************************************************************//**
+** Large allocations get their own block, kept behind the current one so
+** that its free space is not lost
+*/
+void * ArenaRegion::allocate(size_t const size)
+{
+	size_t const rounded = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+	if (rounded == 0)
+		return 0;
+
+	if (rounded > SizeClassArena::MAX_BLOCK_SIZE - HEADER_SIZE) {
+		block * const current = blocks;
+		block * const b = add_block(HEADER_SIZE + rounded);
+		if (b == 0)
+			return 0;
+		if (current != 0) {
+			blocks = current;
+			b->next = current->next;
+			current->next = b;
+		}
+		used += rounded;
+		return (uint8_t *)b + HEADER_SIZE;
+	}
+
+	if ((size_t)(limit - cursor) < rounded) {
+		block * const b = add_block(SizeClassArena::MAX_BLOCK_SIZE);
+		if (b == 0)
+			return 0;
+		cursor = (uint8_t *)b + HEADER_SIZE;
+		limit = (uint8_t *)b + SizeClassArena::MAX_BLOCK_SIZE;
+	}
+	void * const ptr = cursor;
+	cursor += rounded;
+	used += rounded;
+	return ptr;
+}
+
+
+/*************************************************************************//**
+**
+*/
+char * ArenaRegion::duplicate(char const * const src, size_t const len)
+{
+	char * const dst = static_cast<char *>(allocate(len + 1));
+	if (dst != 0) {
+		memcpy(dst, src, len);
+		dst[len] = 0;
+	}
+	return dst;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void ArenaRegion::reset()
+{
+	while (blocks != 0) {
+		block * const next = blocks->next;
+		arena->release(blocks, blocks->size);
+		blocks = next;
+	}
+	cursor = limit = 0;
+	used = 0;
+}
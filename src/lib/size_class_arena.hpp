@@ -0,0 +1,200 @@
+/**
+******************************************************************************
+* @file    size_class_arena.hpp
+* @brief   Size class allocator for variable length data, and regions
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __SIZE_CLASS_ARENA_HPP_INCLUDED
+#define __SIZE_CLASS_ARENA_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error size_class_arena.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pool_allocator.hpp"
+#include "metrics_registry.hpp"
+
+
+#define ARENA_ALIGN        16
+#define ARENA_CHUNK_BYTES  4096
+
+
+struct arena_class_stats {
+	size_t block_size;   // 0 for the blocks above the largest class
+	uint32_t in_use;     // Blocks
+	uint32_t peak;
+	uint32_t capacity;   // Blocks the class pool currently holds
+	uint64_t requested;  // Bytes asked for by the blocks in use
+	uint64_t allocs;     // Since creation
+	uint64_t failures;
+};
+
+
+/*************************************************************************//**
+**
+** Allocator for variable length data (payloads, strings): sizes are
+** rounded up to a power of two class, from 16 bytes to 4 KiB, each served
+** by its own PoolAllocator, created on first use. Larger blocks come from
+** the heap. Blocks are 16 bytes aligned.
+**
+** The size is not stored with the block: release() must be given the exact
+** size that was asked for, the per class byte counters rely on it.
+**
+** Not thread safe: meant to be owned by one reactor, see
+** SocketServer::get_arena(). Per class counters tell the usage, the peak,
+** the bytes lost to rounding (internal fragmentation) and the free blocks
+** held by the pools (external fragmentation). They are reported to the
+** MetricsRegistry as well, under "arena": get_stats() only reads counters
+** the owner publishes with atomic stores, and may be called from any thread.
+**
+*****************************************************************************/
+
+class SizeClassArena : public MetricsSource
+{
+public:
+	static const unsigned MIN_SHIFT = 4;
+	static const unsigned MAX_SHIFT = 12;
+	static const unsigned CLASS_COUNT = MAX_SHIFT - MIN_SHIFT + 1;
+	static const size_t MAX_BLOCK_SIZE = 1 << MAX_SHIFT;
+
+	SizeClassArena();
+	virtual ~SizeClassArena();
+
+	/**
+	 * @return 0 if @a size is 0 or memory is exhausted
+	 */
+	void * allocate(size_t size);
+	void release(void * ptr, size_t size);
+
+	/**
+	 * Usable size of a block allocated for @a size bytes
+	 */
+	static size_t block_size(size_t size);
+
+	/**
+	 * @a cls: 0 .. CLASS_COUNT - 1, CLASS_COUNT for the large blocks.
+	 * Callable from any thread: the counters are read one by one, and may
+	 * then be a few allocations apart.
+	 * @return 0 on success, -1 if @a cls is out of range
+	 */
+	int get_stats(unsigned cls, arena_class_stats * stats) const;
+	void dump_stats() const;
+
+	std::string get_metrics_name() const;
+	void report_metrics(metric_samples_t & out) const;
+
+private:
+	/**
+	 * Type erased pool of one class
+	 */
+	class size_class {
+	public:
+		virtual ~size_class() {}
+		virtual void * alloc() = 0;
+		virtual void free(void * ptr) = 0;
+	};
+
+	/**
+	 * Written by the owner only, read by get_stats() from any thread.
+	 * Word sized: lock free atomics on 32 bit targets as well.
+	 */
+	struct class_counters {
+		unsigned long in_use;
+		unsigned long peak;
+		unsigned long capacity;   // Updated by the class pool as it grows or trims
+		unsigned long requested;
+		unsigned long allocs;
+		unsigned long failures;
+	};
+
+	template <size_t SIZE> class size_class_pool;
+
+	static unsigned class_of(size_t size);
+	size_class * get_class(unsigned cls);
+
+	SizeClassArena(SizeClassArena const &);
+	SizeClassArena & operator=(SizeClassArena const &);
+
+private:
+	size_class * classes[CLASS_COUNT];
+	class_counters counters[CLASS_COUNT + 1];
+};
+
+
+/*************************************************************************//**
+**
+** Request scoped allocations: blocks are carved one after the other from
+** 4 KiB arena blocks and never released one by one; reset() (or the
+** destructor) gives everything back at once. Allocations too large for a
+** block get a heap block of their own.
+**
+*****************************************************************************/
+
+class ArenaRegion
+{
+public:
+	ArenaRegion(SizeClassArena * arena);
+	virtual ~ArenaRegion();
+
+	/**
+	 * @return 16 bytes aligned storage, 0 if memory is exhausted
+	 */
+	void * allocate(size_t size);
+	/**
+	 * Copy of @a len bytes of @a src, zero terminated
+	 */
+	char * duplicate(char const * src, size_t len);
+
+	void reset();
+
+	size_t get_used() const {
+		return used;
+	}
+
+private:
+	struct block {
+		block * next;
+		size_t size;  // As allocated from the arena, header included
+	};
+
+	static const size_t HEADER_SIZE = (sizeof(block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	block * add_block(size_t size);
+
+	ArenaRegion(ArenaRegion const &);
+	ArenaRegion & operator=(ArenaRegion const &);
+
+private:
+	SizeClassArena * arena;
+	block * blocks;
+	uint8_t * cursor;
+	uint8_t * limit;
+	size_t used;
+};
+
+
+/****************************************************************************/
+
+#endif /* __SIZE_CLASS_ARENA_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,194 @@
+/**
+******************************************************************************
+* @file    sock_connection.cpp
+*****************************************************************************/
+
+#include <errno.h>
+#include <sys/socket.h>
+#include "sock_connection.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+**
+*/
+SocketConnection::SocketConnection(SocketServer * const server, int const fd):
+	SocketHandler(server),
+	fd(fd)
+{
+}
+
+
+/*************************************************************************//**
+**
+*/
+SocketConnection::~SocketConnection()
+{
+	release(rx_ring);
+	release(tx_ring);
+}
+
+
+/*************************************************************************//**
+** Take a storage block from the server pool for @a ring, if needed
+*/
+bool SocketConnection::acquire(RingBuffer &ring)
+{
+	if (ring.is_attached())
+		return true;
+	socket_buffer * const blk = get_server()->get_buffer_pool()->alloc_object();
+	if (blk == 0) {
+		_ERROR() << "fd " << fd << " no socket buffer available";
+		return false;
+	}
+	ring.attach(blk->data, SOCKET_BUFFER_SIZE);
+	return true;
+}
+
+
+/*************************************************************************//**
+** Give the storage block of @a ring back to the server pool
+*/
+void SocketConnection::release(RingBuffer &ring)
+{
+	if (!ring.is_attached())
+		return;
+	get_server()->get_buffer_pool()->free_object(reinterpret_cast<socket_buffer *>(ring.detach()));
+}
+
+
+/*************************************************************************//**
+** Read from the socket into the free space of the receive ring
+** @param[out] requested number of bytes asked for
+** @return as recv(): bytes read, 0 on EOF, -1 on error (errno set)
+*/
+ssize_t SocketConnection::fill_rx(size_t &requested)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	if (!acquire(rx_ring)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = rx_ring.get_write_iov(iov);
+	requested = rx_ring.space();
+
+	ssize_t const res = recvmsg(fd, &msg, MSG_DONTWAIT);
+	if (res > 0)
+		rx_ring.commit(res);
+	else
+	if (rx_ring.empty())
+		release(rx_ring);
+	return res;
+}
+
+
+/*************************************************************************//**
+** Store data already received (completion backends) into the receive
+** ring, passing it to the handler as the ring fills up
+*/
+int SocketConnection::push_rx(const uint8_t * data, size_t len)
+{
+	int res = 1;
+
+	while (len > 0) {
+		if (!acquire(rx_ring))
+			return -1;
+		uint32_t const n = rx_ring.write(data, len);
+		data += n;
+		len -= n;
+		res = dispatch_rx();
+		if (res <= 0)
+			return res;
+	}
+	return res;
+}
+
+
+/*************************************************************************//**
+** Pass received data to the handler
+*/
+int SocketConnection::dispatch_rx()
+{
+	int const res = on_receive(rx_ring);
+	if (res <= 0)
+		return res;
+	if (rx_ring.empty()) {
+		release(rx_ring);
+	} else
+	if (rx_ring.full()) {
+		_ERROR() << "fd " << fd << " receive ring overflow";
+		return -1;
+	}
+	return res;
+}
+
+
+/*************************************************************************//**
+** Send data, queuing in the transmit ring what the socket can't take now.
+** Data already queued is always sent first, so ordering is preserved.
+** @return number of bytes sent or queued (less than @a len if the ring is
+**         full), -1 on socket error
+*/
+ssize_t SocketConnection::send(const void * const data, size_t const len)
+{
+	ssize_t sent = 0;
+
+	if (tx_ring.empty()) {
+		sent = ::send(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0) {
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+				_LSYSERROR("send error");
+				return -1;
+			}
+			sent = 0;
+		}
+		if ((size_t)sent == len)
+			return sent;
+	}
+
+	if (!acquire(tx_ring))
+		return sent;
+	bool const was_empty = tx_ring.empty();
+	sent += tx_ring.write((const uint8_t *)data + sent, len - sent);
+	if (was_empty && !tx_ring.empty())
+		get_server()->set_output_interest(fd, true);
+	return sent;
+}
+
+
+/*************************************************************************//**
+** Flush the transmit ring; output interest is dropped once it is empty
+*/
+int SocketConnection::on_output_ready(int)
+{
+	struct iovec iov[2];
+	struct msghdr msg;
+
+	while (!tx_ring.empty()) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = tx_ring.get_read_iov(iov);
+		ssize_t const res = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (res < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 1; // Partial write: wait for the next notification
+			if (errno == EINTR)
+				continue;
+			_LSYSERROR("sendmsg error");
+			return -1;
+		}
+		tx_ring.consume(res);
+	}
+
+	release(tx_ring);
+	get_server()->set_output_interest(fd, false);
+	on_tx_drained();
+	return 1;
+}
@@ -0,0 +1,115 @@
+/**
+******************************************************************************
+* @file    sock_connection.hpp
+* @brief   Socket handler with pooled receive and transmit ring buffers
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __SOCK_CONNECTION_HPP_INCLUDED
+#define __SOCK_CONNECTION_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error sock_connection.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include "ring_buffer.hpp"
+#include "sock_server.hpp"
+
+
+/*************************************************************************//**
+**
+** A connected socket with a receive and a transmit ring, both backed by
+** blocks of the server's SocketBufferPool. A block is taken only while its
+** ring holds data and is returned as soon as the ring drains, so idle
+** connections cost no buffer memory.
+**
+** Incoming data is read by the server straight into the receive ring and
+** passed to on_receive(). Outgoing data goes through send(): whatever the
+** socket does not accept at once is queued in the transmit ring and
+** flushed when the socket becomes writable; output interest is enabled
+** only while the transmit ring is not empty.
+**
+*****************************************************************************/
+
+class SocketConnection : public SocketHandler
+{
+	friend class SocketServer;
+
+public:
+	SocketConnection(SocketServer * server, int fd);
+	virtual ~SocketConnection();
+
+	SocketConnection * get_connection() {
+		return this;
+	}
+	int get_fd() const {
+		return fd;
+	}
+
+	ssize_t send(const void * data, size_t len);
+
+	size_t tx_pending() const {
+		return tx_ring.size();
+	}
+	size_t tx_space() const {
+		return tx_ring.is_attached() ? tx_ring.space() : SOCKET_BUFFER_SIZE;
+	}
+
+protected:
+	/**
+	 * New data is available in @a rx. The handler consumes what it can
+	 * process; unconsumed bytes are kept for the next call. A handler
+	 * leaving the ring full closes the connection.
+	 * @return > 0 to keep the connection, <= 0 to close it
+	 */
+	virtual int on_receive(RingBuffer & rx) {
+		rx.consume(rx.size());
+		return 1;
+	}
+
+	/**
+	 * The transmit ring has been completely flushed: a good time to
+	 * queue the next part of a large response.
+	 */
+	virtual void on_tx_drained() {
+	}
+
+	int on_output_ready(int);
+
+private:
+	ssize_t fill_rx(size_t &requested);
+	int push_rx(const uint8_t * data, size_t len);
+	int dispatch_rx();
+	bool acquire(RingBuffer &ring);
+	void release(RingBuffer &ring);
+
+private:
+	int fd;
+	RingBuffer rx_ring;
+	RingBuffer tx_ring;
+};
+
+
+/****************************************************************************/
+
+#endif /* __SOCK_CONNECTION_HPP_INCLUDED */
+/* EOF */
@@ -0,0 +1,231 @@
+/**
+******************************************************************************
+* @file    sock_datagram.cpp
+*****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include "sock_datagram.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+**
+*/
+DatagramBatch::DatagramBatch(SocketBufferPool * const pool, unsigned const size):
+	pool(pool),
+	buffers_ready(false),
+	msgs(size ? size : 1),
+	iovs(msgs.size()),
+	peers(msgs.size()),
+	blocks(msgs.size(), 0),
+	dgrams(msgs.size())
+{
+	memset(&msgs[0], 0, msgs.size() * sizeof(struct mmsghdr));
+	for (unsigned i = 0; i < msgs.size(); i++) {
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &peers[i];
+		dgrams[i].peer = reinterpret_cast<struct sockaddr *>(&peers[i]);
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+DatagramBatch::~DatagramBatch()
+{
+	for (unsigned i = 0; i < blocks.size(); i++)
+		if (blocks[i] != 0)
+			pool->free_object(blocks[i]);
+}
+
+
+/*************************************************************************//**
+** Blocks are taken on first use and kept: the batch is reused on every
+** read
+*/
+bool DatagramBatch::acquire_buffers()
+{
+	if (buffers_ready)
+		return true;
+	for (unsigned i = 0; i < blocks.size(); i++) {
+		if (blocks[i] != 0)
+			continue;
+		blocks[i] = pool->alloc_object();
+		if (blocks[i] == 0) {
+			_ERROR() << "no socket buffer available for datagram batch";
+			return false;
+		}
+		iovs[i].iov_base = blocks[i]->data;
+		iovs[i].iov_len = SOCKET_BUFFER_SIZE;
+		dgrams[i].data = blocks[i]->data;
+	}
+	buffers_ready = true;
+	return true;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int DatagramBatch::receive(int const fd)
+{
+	if (!acquire_buffers()) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (unsigned i = 0; i < msgs.size(); i++)
+		msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+
+	int const cnt = recvmmsg(fd, &msgs[0], msgs.size(), MSG_DONTWAIT, 0);
+	for (int i = 0; i < cnt; i++) {
+		dgrams[i].len = msgs[i].msg_len;
+		dgrams[i].peer_len = msgs[i].msg_hdr.msg_namelen;
+		dgrams[i].truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+	}
+	return cnt;
+}
+
+
+/*************************************************************************//**
+**
+*/
+DatagramHandler::DatagramHandler(SocketServer * const server, unsigned const tx_queue_size):
+	SocketHandler(server),
+	tx_fd(-1),
+	tx_head(0),
+	tx_count(0),
+	tx_waiting(false),
+	tx_msgs(tx_queue_size ? tx_queue_size : 1),
+	tx_iovs(tx_msgs.size()),
+	tx_peers(tx_msgs.size()),
+	tx_blocks(tx_msgs.size(), 0)
+{
+	memset(&tx_msgs[0], 0, tx_msgs.size() * sizeof(struct mmsghdr));
+	for (unsigned i = 0; i < tx_msgs.size(); i++) {
+		tx_msgs[i].msg_hdr.msg_iov = &tx_iovs[i];
+		tx_msgs[i].msg_hdr.msg_iovlen = 1;
+		tx_msgs[i].msg_hdr.msg_name = &tx_peers[i];
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+DatagramHandler::~DatagramHandler()
+{
+	release_sent(tx_count - tx_head);
+}
+
+
+/*************************************************************************//**
+** Give the blocks of the @a count oldest queued datagrams back to the pool
+*/
+void DatagramHandler::release_sent(unsigned const count)
+{
+	SocketBufferPool * const pool = get_server()->get_buffer_pool();
+	for (unsigned i = 0; i < count; i++, tx_head++) {
+		pool->free_object(tx_blocks[tx_head]);
+		tx_blocks[tx_head] = 0;
+	}
+	if (tx_head == tx_count)
+		tx_head = tx_count = 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int DatagramHandler::send_to(int const fd, const void * const data, size_t const len,
+							 const struct sockaddr * const peer, socklen_t const peer_len)
+{
+	if ((len > SOCKET_BUFFER_SIZE) || (peer_len > sizeof(struct sockaddr_storage))) {
+		_ERROR() << "fd " << fd << " datagram too long (" << len << ")";
+		return -1;
+	}
+	// A sendmmsg call addresses a single socket
+	if ((tx_count != tx_head) && (fd != tx_fd) && (flush() != 0)) {
+		_VBL(3) << "fd " << fd << " datagram queue busy with fd " << tx_fd;
+		return -1;
+	}
+	if ((tx_count == tx_msgs.size()) && (flush() != 0) && (tx_count == tx_msgs.size())) {
+		if (tx_head == 0) {
+			_VBL(3) << "fd " << fd << " datagram queue full";
+			return -1;
+		}
+		// Move what the socket didn't take to the front
+		unsigned const n = tx_count - tx_head;
+		for (unsigned i = 0; i < n; i++) {
+			tx_blocks[i] = tx_blocks[tx_head + i];
+			tx_peers[i] = tx_peers[tx_head + i];
+			tx_iovs[i] = tx_iovs[tx_head + i];
+			tx_msgs[i].msg_hdr.msg_namelen = tx_msgs[tx_head + i].msg_hdr.msg_namelen;
+		}
+		tx_head = 0;
+		tx_count = n;
+	}
+
+	socket_buffer * const blk = get_server()->get_buffer_pool()->alloc_object();
+	if (blk == 0) {
+		_ERROR() << "fd " << fd << " no socket buffer available";
+		return -1;
+	}
+	memcpy(blk->data, data, len);
+	memcpy(&tx_peers[tx_count], peer, peer_len);
+
+	tx_blocks[tx_count] = blk;
+	tx_iovs[tx_count].iov_base = blk->data;
+	tx_iovs[tx_count].iov_len = len;
+	tx_msgs[tx_count].msg_hdr.msg_namelen = peer_len;
+	tx_count++;
+	tx_fd = fd;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Datagrams refused by the socket for another reason than a full buffer
+** are dropped, as the network would do.
+*/
+unsigned DatagramHandler::flush()
+{
+	while (tx_head < tx_count) {
+		int const res = sendmmsg(tx_fd, &tx_msgs[tx_head], tx_count - tx_head,
+								 MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (res < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				if (!tx_waiting && (get_server()->set_output_interest(tx_fd, true) == 0))
+					tx_waiting = true;
+				return tx_count - tx_head;
+			}
+			if (errno == EINTR)
+				continue;
+			_LSYSERROR("sendmmsg error");
+			release_sent(1);
+			continue;
+		}
+		release_sent(res);
+	}
+
+	if (tx_waiting) {
+		get_server()->set_output_interest(tx_fd, false);
+		tx_waiting = false;
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int DatagramHandler::on_output_ready(int)
+{
+	flush();
+	return 1;
+}
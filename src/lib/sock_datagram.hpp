@@ -0,0 +1,162 @@
+/**
+******************************************************************************
+* @file    sock_datagram.hpp
+* @brief   Batched datagram reception and transmission
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __SOCK_DATAGRAM_HPP_INCLUDED
+#define __SOCK_DATAGRAM_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error sock_datagram.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <vector>
+#include "ring_buffer.hpp"
+#include "sock_server.hpp"
+
+using namespace std;
+
+
+/*************************************************************************//**
+** A received datagram; data and peer address are owned by the server and
+** only valid during DatagramHandler::on_datagrams()
+*/
+struct datagram {
+	const uint8_t * data;
+	size_t len;
+	const struct sockaddr * peer;
+	socklen_t peer_len;
+	bool truncated; // longer than SOCKET_BUFFER_SIZE, the rest is lost
+};
+
+
+/*************************************************************************//**
+** Receive side: an array of message headers over SocketBufferPool blocks,
+** filled by a single recvmmsg. Owned by the server and shared by all of
+** its datagram sockets, since a batch is handed over and done with before
+** the next one is read.
+*/
+class DatagramBatch
+{
+public:
+	DatagramBatch(SocketBufferPool * pool, unsigned size);
+	~DatagramBatch();
+
+	/**
+	 * Read up to get_size() datagrams from @a fd without blocking
+	 * @return as recvmmsg(): number of datagrams, -1 on error (errno set)
+	 */
+	int receive(int fd);
+
+	const struct datagram * get() const {
+		return &dgrams[0];
+	}
+	unsigned get_size() const {
+		return msgs.size();
+	}
+
+private:
+	bool acquire_buffers();
+
+private:
+	SocketBufferPool * pool;
+	bool buffers_ready;
+	vector<struct mmsghdr> msgs;
+	vector<struct iovec> iovs;
+	vector<struct sockaddr_storage> peers;
+	vector<socket_buffer *> blocks;
+	vector<struct datagram> dgrams;
+};
+
+
+/*************************************************************************//**
+**
+** Handler of a datagram socket receiving whole batches: the server drains
+** the socket with recvmmsg and passes every batch to on_datagrams().
+**
+** Replies go through send_to(), which queues them (copied into pool
+** blocks) and sends the queue with a single sendmmsg once the current
+** batch has been handled, or when the queue is full. What the socket does
+** not accept is kept and flushed when it becomes writable.
+**
+*****************************************************************************/
+
+class DatagramHandler : public SocketHandler
+{
+public:
+	static const unsigned DEFAULT_TX_QUEUE_SIZE = 64;
+
+	DatagramHandler(SocketServer * server, unsigned tx_queue_size = DEFAULT_TX_QUEUE_SIZE);
+	virtual ~DatagramHandler();
+
+	DatagramHandler * get_datagram_handler() {
+		return this;
+	}
+
+	/**
+	 * @a count datagrams received on socket @a fd
+	 * @return > 0 to keep the socket, <= 0 to close it
+	 */
+	virtual int on_datagrams(int, const struct datagram *, unsigned) {
+		return 1;
+	}
+
+	/**
+	 * Queue a datagram for @a peer on socket @a fd
+	 * @return 0 if queued, -1 if too long or the queue can't be emptied
+	 */
+	int send_to(int fd, const void * data, size_t len,
+				const struct sockaddr * peer, socklen_t peer_len);
+	/**
+	 * Send the queue now
+	 * @return number of datagrams still queued (socket not writable)
+	 */
+	unsigned flush();
+
+	unsigned tx_pending() const {
+		return tx_count - tx_head;
+	}
+
+	int on_output_ready(int);
+
+private:
+	void release_sent(unsigned count);
+
+private:
+	int tx_fd;
+	unsigned tx_head;
+	unsigned tx_count;
+	bool tx_waiting;
+	vector<struct mmsghdr> tx_msgs;
+	vector<struct iovec> tx_iovs;
+	vector<struct sockaddr_storage> tx_peers;
+	vector<socket_buffer *> tx_blocks;
+};
+
+
+/****************************************************************************/
+
+#endif /* __SOCK_DATAGRAM_HPP_INCLUDED */
+/* EOF */
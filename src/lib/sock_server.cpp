@@ -9,11 +9,16 @@
 #include <sys/types.h> 
 #include <sys/socket.h>
 #include <sys/signalfd.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
-#include "epoll_fds_mgr.hpp"
 #include "sock_server.hpp"
+#include "sock_connection.hpp"
+#include "sock_datagram.hpp"
+#include "timer_wheel.hpp"
+#include "size_class_arena.hpp"
+#include "work_pool.hpp"
 
 #include "typedumpers.hpp"
 #include "logging.hpp"
@@ -84,11 +89,36 @@ static inline sigset_t _blocked_signals(void)
 /*************************************************************************//**
 **
 */
-SocketServer::SocketServer()
+SocketServer::SocketServer(IOEventManager::backend_type const backend):
+	buffer_pool(INITIAL_BUFFER_POOL_SIZE),
+	wakeup_handler(this)
 {
 	instance_thread = pthread_self();
+	ioev_manager = IOEventManager::create(backend);
 	poll_timeout.tv_sec = 1;
 	poll_timeout.tv_nsec = 0;
+	io_budget = DEFAULT_IO_BUDGET;
+	reuse_port = false;
+	rx_buffer = 0;
+	rx_buffer_size = 0;
+	set_rx_buffer_size(DEFAULT_RX_BUFFER_SIZE);
+	dgram_batch = 0;
+	dgram_batch_size = DEFAULT_DATAGRAM_BATCH_SIZE;
+	timer_wheel = 0;
+	completions = 0;
+	arena = 0;
+	stop_requested = false;
+	
+	// Lets stop() interrupt a wait without timeout; the plain handler
+	// ignores the event, run() only needs to wake up.
+	wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeup_fd < 0) {
+		_LSYSERROR("eventfd error");
+	} else
+	if (add_event_fd(&wakeup_handler, wakeup_fd) != 0) {
+		close(wakeup_fd);
+		wakeup_fd = -1;
+	}
 }
 
 
@@ -97,7 +127,14 @@ SocketServer::SocketServer()
 */
 SocketServer::~SocketServer()
 {
-	ioev_manager.close_all();
+	delete timer_wheel;
+	delete completions;
+	ioev_manager->close_all();
+	delete ioev_manager;
+	delete dgram_batch;
+	free(rx_buffer);
+	// Last: handlers closed above may still release arena blocks
+	delete arena;
 }
 
 
@@ -144,6 +181,16 @@ bool SocketServer::set_nonblocking(int const sockfd)
 }
 
 
+/*************************************************************************//**
+** Sockets are always registered with their SocketHandler as user data
+*/
+static inline bool is_edge_triggered(void * const udata)
+{
+	SocketHandler const * const h = static_cast<SocketHandler *>(udata);
+	return (h != 0) && h->is_edge_triggered();
+}
+
+
 /*************************************************************************//**
 **
 */
@@ -172,6 +219,21 @@ int SocketServer::add_server_socket(int sock_type, int backlog, struct sockaddr
 		goto close_and_exit_with_error;
 	}
 
+	if (reuse_port) {
+		// Several sockets (one per reactor) bound to the same address:
+		// the kernel spreads incoming connections and datagrams among them
+#ifdef SO_REUSEPORT
+		res = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+#else
+		res = -1;
+		errno = ENOPROTOOPT;
+#endif
+		if (res < 0) {
+			_LSYSERROR("setsockopt SO_REUSEPORT failed");
+			goto close_and_exit_with_error;
+		}
+	}
+
 	if (set_nonblocking(sockfd) == false)
 		goto close_and_exit_with_error;
 	
@@ -187,9 +249,9 @@ int SocketServer::add_server_socket(int sock_type, int backlog, struct sockaddr
 			_LSYSERROR("listen error");
 			goto close_and_exit_with_error;
 		}
-		res = ioev_manager.add_server_socket(sockfd, udata);
+		res = ioev_manager->add_server_socket(sockfd, udata, is_edge_triggered(udata));
 	} else
-		res = ioev_manager.add_socket(sockfd, udata);
+		res = ioev_manager->add_datagram_socket(sockfd, udata, is_edge_triggered(udata));
 
 	if (res == 0)
 		return sockfd;
@@ -284,7 +346,7 @@ int SocketServer::add_signal_handler(SocketHandler * handler, const sigset_t *ma
 	set_nonblocking(sigfd);
 	
 	IOEventManager::event_flags events = IOEventManager::EV_IN;
-	int res = ioev_manager.add_fd(sigfd, events, handler, IOEventManager::FDIF_NONSOCKET);
+	int res = ioev_manager->add_fd(sigfd, events, handler, IOEventManager::FDIF_NONSOCKET);
 	if (res != 0) {
 		close(sigfd);
 		return -1;
@@ -296,6 +358,66 @@ int SocketServer::add_signal_handler(SocketHandler * handler, const sigset_t *ma
 }
 
 
+/*************************************************************************//**
+** Register a counter descriptor (eventfd, timerfd): on every notification
+** the 8 byte counter is read and passed to handler->on_event(). The
+** descriptor is switched to non blocking mode.
+*/
+int SocketServer::add_event_fd(SocketHandler * const handler, int const fd)
+{
+	if ((handler == 0) || (set_nonblocking(fd) == false))
+		return -1;
+	
+	IOEventManager::event_flags events = IOEventManager::EV_IN;
+	return ioev_manager->add_fd(fd, events, handler,
+							IOEventManager::FDIF_NONSOCKET | IOEventManager::FDIF_COUNTER);
+}
+
+
+/*************************************************************************//**
+** Timers of this server, created on first use
+*/
+TimerWheel * SocketServer::get_timer_wheel()
+{
+	if (timer_wheel == 0) {
+		timer_wheel = new TimerWheel(this);
+		if (!timer_wheel->is_ready()) {
+			delete timer_wheel;
+			timer_wheel = 0;
+		}
+	}
+	return timer_wheel;
+}
+
+
+/*************************************************************************//**
+** Completions of the WorkPool tasks submitted from this server, created on
+** first use
+*/
+WorkCompletionQueue * SocketServer::get_completion_queue()
+{
+	if (completions == 0) {
+		completions = new WorkCompletionQueue(this);
+		if (!completions->is_ready()) {
+			delete completions;
+			completions = 0;
+		}
+	}
+	return completions;
+}
+
+
+/*************************************************************************//**
+** Variable size allocations of this server's thread, created on first use
+*/
+SizeClassArena * SocketServer::get_arena()
+{
+	if (arena == 0)
+		arena = new SizeClassArena();
+	return arena;
+}
+
+
 /*************************************************************************//**
 **
 */
@@ -312,7 +434,11 @@ int SocketServer::change_signal_handler_signals(SocketHandler * handler, const s
 */
 int SocketServer::add_accepted_socket(int conn_sock, SocketHandler *new_handler)
 {
-	return ioev_manager.add_socket(conn_sock, new_handler);
+	bool const edge = new_handler->is_edge_triggered();
+	// Draining until EAGAIN needs a non blocking socket
+	if (edge && (set_nonblocking(conn_sock) == false))
+		return -1;
+	return ioev_manager->add_socket(conn_sock, new_handler, edge);
 }
 
 
@@ -321,7 +447,7 @@ int SocketServer::add_accepted_socket(int conn_sock, SocketHandler *new_handler)
 */
 int SocketServer::remove_socket(int conn_sock, IOEventManager::event_descriptor event)
 {
-	event->rem_socket(&ioev_manager);
+	ioev_manager->rem_socket(event);
 	return close(conn_sock);
 }
 
@@ -331,7 +457,7 @@ int SocketServer::remove_socket(int conn_sock, IOEventManager::event_descriptor
 */
 int SocketServer::rem_fd(int fd, SocketHandler **sock_handler)
 {
-	return ioev_manager.rem_fd(fd, (void **)sock_handler);
+	return ioev_manager->rem_fd(fd, (void **)sock_handler);
 }
 
 
@@ -357,62 +483,149 @@ int SocketServer::process_signal_handler(int const sigfd, SocketHandler * const
 /*************************************************************************//**
 **
 */
-int SocketServer::process_incoming_connection(int const svr_sock, SocketHandler * const handler)
+int SocketServer::process_event_fd(int const fd, SocketHandler * const handler)
+{
+	uint64_t count;
+	
+	ssize_t const res = read(fd, &count, sizeof(count));
+	if (res != sizeof(count)) {
+		if ((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return 0; // Already read
+		_LSYSERROR("event fd read error");
+		return -1;
+	}
+	return handler->on_event(fd, count);
+}
+
+
+/*************************************************************************//**
+** Let the listener accept (or refuse) a new connection and register it
+*/
+int SocketServer::setup_connection(int const svr_sock, int const conn_sock,
+								   struct sockaddr * const addr, socklen_t const addrlen,
+								   SocketHandler * const handler)
+{
+	ConnectionInfo ci;
+	SocketHandler * new_handler;
+
+	ci.listen_sock = svr_sock;
+	ci.connect_sock = conn_sock;
+	ci.peer_address_len = addrlen;
+	ci.peer_address = addr;
+	
+	new_handler = handler->on_connect(&ci);
+	if (new_handler == 0) {
+		_VBL(2) << "on_connect returned null pointer";
+		close(conn_sock);
+		return -1;
+	}
+	
+	//_dump_accepted(svr_sock, conn_sock, &acpt_addr);
+	if (add_accepted_socket(conn_sock, new_handler) != 0) {
+		new_handler->on_disconnect(conn_sock);
+		close(conn_sock);
+		return -1;
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int SocketServer::process_incoming_connection(int const svr_sock, bool const edge_triggered, SocketHandler * const handler)
 {
 	struct sockaddr_in acpt_addr;
 	socklen_t addrlen;
 	int conn_sock = 0;
-	ConnectionInfo ci;
-	SocketHandler * new_handler;
 
-	for(;;) {
+	for (unsigned n = 0; n < io_budget; n++) {
 		addrlen = sizeof(struct sockaddr_in);
 		conn_sock = accept(svr_sock, (struct sockaddr*)&acpt_addr, &addrlen);
 		if (conn_sock == -1) {
 			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
 				return 0; // All backlogged connections have been accepted
+			if ((errno == EINTR) || (errno == ECONNABORTED))
+				continue;
 			// Error accepting new connection
 			_LSYSERROR("accept error");
 			return -1;
 		}
 
-		ci.listen_sock = svr_sock;
-		ci.connect_sock = conn_sock;
-		ci.peer_address_len = addrlen;
-		ci.peer_address = (struct sockaddr*)&acpt_addr;
-		
-		new_handler = handler->on_connect(&ci);
-		if (new_handler == 0) {
-			_VBL(2) << "on_connect returned null pointer";
-			close(conn_sock);
-			return -1;
-		}
-		
-		//_dump_accepted(svr_sock, conn_sock, &acpt_addr);
-		add_accepted_socket(conn_sock, new_handler);
+		setup_connection(svr_sock, conn_sock, (struct sockaddr*)&acpt_addr, addrlen, handler);
 	}
 	
-	return -1;
+	// Budget exhausted: let other descriptors run, then come back
+	// (a level triggered listener will be reported again anyway)
+	if (edge_triggered)
+		ioev_manager->defer_fd(svr_sock);
+	return 0;
 }
 
 
 /*************************************************************************//**
-**
+** Connection already accepted by a completion backend
+*/
+int SocketServer::process_accepted_connection(int const svr_sock, int const conn_sock, SocketHandler * const handler)
+{
+	struct sockaddr_in peer_addr;
+	socklen_t addrlen = sizeof(struct sockaddr_in);
+
+	if (getpeername(conn_sock, (struct sockaddr*)&peer_addr, &addrlen) < 0) {
+		_LSYSERROR("getpeername error");
+		memset(&peer_addr, 0, sizeof(peer_addr));
+		addrlen = 0;
+	}
+	return setup_connection(svr_sock, conn_sock, (struct sockaddr*)&peer_addr, addrlen, handler);
+}
+
+
+/*************************************************************************//**
+** Read available data and hand it over to the handler: a single recv per
+** readiness event, whose result also reports EOF and errors. In level
+** triggered mode the handler is called once per event; in edge triggered
+** mode reading goes on until the socket is drained, but no more than
+** io_budget times in a row so that a single busy peer can't starve the
+** others.
+** @return 0 on disconnection, < 0 on error, > 0 otherwise
 */
-int SocketServer::process_incoming_data(int const cln_sock, bool const priority, SocketHandler * const handler)
+int SocketServer::process_incoming_data(int const cln_sock, IOEventManager::event_descriptor const event, SocketHandler * const handler)
 {
-	int res, dummy;
-	(void)priority;
+	bool const edge_triggered = event->is_edge_triggered();
+	bool const datagram = event->is_datagram();
+	SocketConnection * const conn = handler->get_connection();
+	size_t requested = rx_buffer_size;
+	ssize_t res;
+	unsigned n = 0;
+	
+	if (event->has_rx_data())
+		return process_received_data(cln_sock, event, handler);
+	if (datagram && (handler->get_datagram_handler() != 0))
+		return process_datagrams(cln_sock, edge_triggered, handler->get_datagram_handler());
 	
 	for(;;) {
-		res = recvfrom(cln_sock, &dummy, 1, MSG_PEEK, 0, 0);
-		if (res > 0) {
-			return handler->on_incoming_data(cln_sock);
-
+		if (conn != 0)
+			res = conn->fill_rx(requested);
+		else
+			res = recv(cln_sock, rx_buffer, rx_buffer_size, MSG_DONTWAIT);
+		if ((res > 0) || ((res == 0) && datagram)) {
+			int hres = (conn != 0) ? conn->dispatch_rx() :
+						handler->on_incoming_data(cln_sock, rx_buffer, res);
+			if ((hres <= 0) || !edge_triggered)
+				return hres;
+			// A short read on a stream socket means its buffer is empty
+			if (!datagram && ((size_t)res < requested))
+				return hres;
+			if (++n >= io_budget) {
+				ioev_manager->defer_fd(cln_sock);
+				return hres;
+			}
 		} else
 		if (res < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 1; // Drained (or spurious wakeup)
 			if (errno != EINTR) {
-				_LSYSERROR("recvfrom error");
+				_LSYSERROR("recv error");
 				break;
 			}
 		} else
@@ -422,6 +635,117 @@ int SocketServer::process_incoming_data(int const cln_sock, bool const priority,
 }
 
 
+/*************************************************************************//**
+** Read datagrams in batches of dgram_batch_size with a single recvmmsg,
+** up to io_budget batches in a row. Replies queued by the handler are
+** sent after each batch. Socket errors (ICMP feedback to a previous send)
+** are logged, the socket is kept.
+** @return <= 0 if the handler asks to close the socket, > 0 otherwise
+*/
+int SocketServer::process_datagrams(int const sock, bool const edge_triggered, DatagramHandler * const handler)
+{
+	if (dgram_batch == 0)
+		dgram_batch = new DatagramBatch(&buffer_pool, dgram_batch_size);
+
+	for (unsigned n = 0; n < io_budget; n++) {
+		int const cnt = dgram_batch->receive(sock);
+		if (cnt < 0) {
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+				return 1; // Drained
+			if (errno == EINTR)
+				continue;
+			_LSYSERROR("recvmmsg error");
+			return 1;
+		}
+		int const hres = handler->on_datagrams(sock, dgram_batch->get(), cnt);
+		handler->flush();
+		if (hres <= 0)
+			return hres;
+		if ((unsigned)cnt < dgram_batch->get_size())
+			return hres; // Drained
+	}
+
+	if (edge_triggered)
+		ioev_manager->defer_fd(sock);
+	return 1;
+}
+
+
+/*************************************************************************//**
+** Data already received by a completion backend: same outcome as a single
+** recv in process_incoming_data()
+*/
+int SocketServer::process_received_data(int const cln_sock, IOEventManager::event_descriptor const event, SocketHandler * const handler)
+{
+	ssize_t const res = event->rx_result;
+	SocketConnection * const conn = handler->get_connection();
+
+	if (res < 0) {
+		errno = -res;
+		_LSYSERROR("recv error");
+		return -1;
+	}
+	if ((res == 0) && !event->is_datagram())
+		return 0;
+	if (conn != 0)
+		return conn->push_rx(event->rx_data, res);
+	return handler->on_incoming_data(cln_sock, event->rx_data, res);
+}
+
+
+/*************************************************************************//**
+**
+*/
+int SocketServer::process_outgoing_data(int const cln_sock, SocketHandler * const handler)
+{
+	return handler->on_output_ready(cln_sock);
+}
+
+
+/*************************************************************************//**
+** Size of the buffer lent to handlers by on_incoming_data(). Datagrams
+** longer than this are truncated.
+*/
+int SocketServer::set_rx_buffer_size(size_t const size)
+{
+	if (size == 0)
+		return -1;
+	uint8_t * const p = static_cast<uint8_t *>(realloc(rx_buffer, size));
+	if (p == 0) {
+		_ERROR() << "rx buffer allocation error";
+		return -1;
+	}
+	rx_buffer = p;
+	rx_buffer_size = size;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Number of datagrams read by a single recvmmsg for datagram handlers;
+** each one takes a SocketBufferPool block.
+*/
+int SocketServer::set_datagram_batch_size(unsigned const size)
+{
+	if (size == 0)
+		return -1;
+	dgram_batch_size = size;
+	delete dgram_batch;
+	dgram_batch = 0;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Maximum number of accept or read rounds granted to an edge triggered
+** descriptor before moving on to the next ready one.
+*/
+void SocketServer::set_io_budget(unsigned const budget)
+{
+	io_budget = (budget == 0) ? 1 : budget;
+}
+
+
 /*************************************************************************//**
 **
 */
@@ -438,14 +762,55 @@ int SocketServer::set_poll_timeout_us(uint32_t const timeout_us)
 
 
 /*************************************************************************//**
-**
+** Wait for events (at most the poll timeout) and serve them
 */
 int SocketServer::process_connections()
+{
+	return dispatch_events(&poll_timeout);
+}
+
+
+/*************************************************************************//**
+** Without the wakeup descriptor stop() could not interrupt the wait: fall
+** back to waiting at most the poll timeout.
+*/
+int SocketServer::run()
+{
+	struct timespec * const tout = (wakeup_fd >= 0) ? 0 : &poll_timeout;
+	
+	_VBL(1) << "SocketServer @" << this << " running";
+	while (!__atomic_load_n(&stop_requested, __ATOMIC_ACQUIRE))
+		dispatch_events(tout);
+	__atomic_store_n(&stop_requested, false, __ATOMIC_RELAXED);
+	_VBL(1) << "SocketServer @" << this << " stopped";
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Only async-signal-safe calls here
+*/
+void SocketServer::stop()
+{
+	uint64_t const one = 1;
+	
+	__atomic_store_n(&stop_requested, true, __ATOMIC_RELEASE);
+	if (wakeup_fd >= 0) {
+		ssize_t const res = write(wakeup_fd, &one, sizeof(one));
+		(void)res; // A full counter wakes the loop as well
+	}
+}
+
+
+/*************************************************************************//**
+** @a tout null waits until some event comes
+*/
+int SocketServer::dispatch_events(struct timespec * const tout)
 {
 	IOEventManager::event_iterator events;
 	IOEventManager::event_descriptor event;
 	
-	events = ioev_manager.wait_for_events(&poll_timeout);
+	events = ioev_manager->wait_for_events(tout);
 	if (events == 0) {
 		_VBL(5) << "wait_for_events zero events";
 		return 0;
@@ -459,7 +824,7 @@ int SocketServer::process_connections()
 		return 0;
 	}
 	
-	event = ioev_manager.get_first_event();
+	event = ioev_manager->get_first_event();
 	while (event) {
 		int fd = event->get_fd();
 		SocketHandler * handler = static_cast<SocketHandler *>(event->get_udata());
@@ -469,6 +834,11 @@ int SocketServer::process_connections()
 			handler->on_disconnect(fd);
 			remove_socket(fd, event);
 		
+		} else
+		if (event->is_counter()) {
+			_VBL(4) << "wait_for_events counter event";
+			process_event_fd(fd, handler);
+		
 		} else
 		if (event->is_signal()) {
 			_VBL(4) << "wait_for_events signalfd event";
@@ -477,20 +847,30 @@ int SocketServer::process_connections()
 		} else
 		if (event->is_incoming_connection()) {
 			_VBL(4) << "wait_for_events connection event";
-			process_incoming_connection(fd, handler);
+			if (event->accepted_fd >= 0)
+				process_accepted_connection(fd, event->accepted_fd, handler);
+			else
+				process_incoming_connection(fd, event->is_edge_triggered(), handler);
 			
 		} else
-		if (event->is_incoming_data()) {
-			_VBL(4) << "wait_for_events data event";
-			int res = process_incoming_data(fd, event->has_priority(), handler);
+		if (event->is_incoming_data() || event->is_output_ready()) {
+			int res = 1;
+			if (event->is_incoming_data()) {
+				_VBL(4) << "wait_for_events data event";
+				res = process_incoming_data(fd, event, handler);
+			}
+			if ((res > 0) && event->is_output_ready()) {
+				_VBL(4) << "wait_for_events output event";
+				res = process_outgoing_data(fd, handler);
+			}
 			if (res <= 0) {
-				_VBL(4) << "process_incoming_data returned 0: disconnection";
+				_VBL(4) << "socket " << fd << " returned " << res << ": disconnection";
 				handler->on_disconnect(fd);
 				remove_socket(fd, event);
 			}
 		}
 		_VBL(5) << "get_next_event";
-		event = ioev_manager.get_next_event();
+		event = ioev_manager->get_next_event();
 	}
 	return 0;
 }
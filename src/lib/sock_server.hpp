@@ -14,7 +14,8 @@
 #include <string.h>
 #include <netdb.h>
 #include <pthread.h>
-#include "epoll_fds_mgr.hpp"
+#include "io_event_mgr.hpp"
+#include "ring_buffer.hpp"
 
 using namespace std;
 
@@ -109,12 +110,19 @@ public:
 *****************************************************************************/
 
 class SocketServer;
+class SocketConnection;
+class DatagramHandler;
+class DatagramBatch;
+class TimerWheel;
+class WorkCompletionQueue;
+class SizeClassArena;
 
 class SocketHandler
 {
 public:
 	SocketHandler(SocketServer * server):
-		server(server)
+		server(server),
+		edge_triggered(false)
 	{}
 	
 	virtual ~SocketHandler()
@@ -134,20 +142,73 @@ public:
 	virtual void on_disconnect(int) {
 	}
 	
-	virtual int on_incoming_data(int) {
+	/**
+	 * Data received on socket @a fd. The buffer is owned by the server and
+	 * is only valid during the call. For datagram sockets each call carries
+	 * exactly one datagram (possibly empty).
+	 * @return > 0 to keep the connection, <= 0 to close it
+	 */
+	virtual int on_incoming_data(int, const uint8_t *, size_t) {
 		return 0;
 	};
 	
+	/**
+	 * Socket @a fd is writable again; only reported while output interest
+	 * is enabled, see SocketServer::set_output_interest().
+	 * @return > 0 to keep the connection, <= 0 to close it
+	 */
+	virtual int on_output_ready(int) {
+		return 1;
+	}
+	
 	virtual int on_signal(int, uint32_t, void *) {
 		return 0;
 	}
 	
+	/**
+	 * Counter descriptor @a fd (eventfd, timerfd) registered with
+	 * SocketServer::add_event_fd() has been read: @a count is its value.
+	 */
+	virtual int on_event(int, uint64_t) {
+		return 0;
+	}
+	
+	/**
+	 * Buffered connections (see SocketConnection) get their data read
+	 * straight into their receive ring instead of on_incoming_data().
+	 */
+	virtual SocketConnection * get_connection() {
+		return 0;
+	}
+	
+	/**
+	 * Datagram handlers (see DatagramHandler) get whole batches of
+	 * datagrams, read with recvmmsg, instead of on_incoming_data().
+	 */
+	virtual DatagramHandler * get_datagram_handler() {
+		return 0;
+	}
+	
 	SocketServer * get_server() const {
 		return server;
 	};
+	
+	/**
+	 * Opt-in edge triggered notification for the sockets served by this
+	 * handler. The server then drains the socket (accept or read) until
+	 * EAGAIN, so the handler shall not leave unread data behind.
+	 * Must be set before the socket is registered.
+	 */
+	void set_edge_triggered(bool const enable) {
+		edge_triggered = enable;
+	}
+	bool is_edge_triggered() const {
+		return edge_triggered;
+	}
 
 private:
 	SocketServer * server;
+	bool edge_triggered;
 };
 
 
@@ -159,19 +220,16 @@ private:
 
 class SocketServer
 {
-// TYPE DEFINITIONS //////////////////////////////////////////////////////////
-private:
-	typedef EPollDescManager IOEventManager;
-
 // METHODS ///////////////////////////////////////////////////////////////////
 public:
-	SocketServer();
+	SocketServer(IOEventManager::backend_type backend = IOEventManager::BACKEND_EPOLL);
 	virtual ~SocketServer();
 	static void print_blocked_signals(const char *prefix);
 
 	int add_handler(SocketHandler * handler);
 	int add_signal_handler(SocketHandler * handler, const sigset_t *mask);
 	int change_signal_handler_signals(SocketHandler * handler, const sigset_t *mask);
+	int add_event_fd(SocketHandler * handler, int fd);
 
 	int rem_fd(int fd, SocketHandler **);
 	int rem_fd(int const fd) {
@@ -179,22 +237,57 @@ public:
 	}
 	
 	int set_poll_timeout_us(uint32_t poll_timeout);
+	void set_reuse_port(bool enable) {
+		reuse_port = enable;
+	}
+	void set_io_budget(unsigned budget);
+	int set_rx_buffer_size(size_t size);
+	int set_datagram_batch_size(unsigned size);
 	int add_server_socket(int sock_type, int backlog, struct sockaddr *address, size_t addr_size, void *udata);
 	int add_server_socket_ip_stream(void *udata, int backlog, uint16_t port, uint32_t addr = INADDR_ANY);
 	int add_socket_ip_datagram(void *udata, uint16_t port, uint32_t addr = INADDR_ANY);
+	int set_output_interest(int fd, bool enable) {
+		return ioev_manager->set_output_interest(fd, enable);
+	}
 	int process_connections();
 	
+	/**
+	 * Serve events until stop() is called, blocking while idle: timers
+	 * (see get_timer_wheel()) take the place of polling.
+	 * @return 0 once stopped
+	 */
+	int run();
+	/**
+	 * Make run() return. Callable from any thread, and from a signal
+	 * handler; if run() is not running it returns at once when called.
+	 */
+	void stop();
+	
+	SocketBufferPool * get_buffer_pool() {
+		return &buffer_pool;
+	}
+	TimerWheel * get_timer_wheel();
+	WorkCompletionQueue * get_completion_queue();
+	SizeClassArena * get_arena();
+	
 	pthread_t get_thread();
 
 protected:
 	virtual int add_accepted_socket(int conn_sock, SocketHandler *new_handler);
 	virtual int remove_socket(int conn_sock, IOEventManager::event_descriptor event);
-	int process_incoming_connection(int svr_sock, SocketHandler *h);
+	int process_incoming_connection(int svr_sock, bool edge_triggered, SocketHandler *h);
+	int process_accepted_connection(int svr_sock, int conn_sock, SocketHandler *h);
 	int process_signal_handler(int sigfd, SocketHandler *h);
-	int process_incoming_data(int cln_sock, bool priority, SocketHandler *h);
+	int process_event_fd(int fd, SocketHandler *h);
+	int process_incoming_data(int cln_sock, IOEventManager::event_descriptor event, SocketHandler *h);
+	int process_received_data(int cln_sock, IOEventManager::event_descriptor event, SocketHandler *h);
+	int process_datagrams(int sock, bool edge_triggered, DatagramHandler *h);
+	int process_outgoing_data(int cln_sock, SocketHandler *h);
 
 private:
+	int dispatch_events(struct timespec *tout);
 	bool set_nonblocking(int sockfd);
+	int setup_connection(int svr_sock, int conn_sock, struct sockaddr *addr, socklen_t addrlen, SocketHandler *h);
 	char* _strerror(int const errnum);
 
 
@@ -203,7 +296,25 @@ private:
 	pthread_t instance_thread;
 	int server_socket;
 	struct timespec poll_timeout;
-	IOEventManager ioev_manager;
+	unsigned io_budget;
+	bool reuse_port;
+	IOEventManager * ioev_manager;
+	uint8_t *rx_buffer;
+	size_t rx_buffer_size;
+	SocketBufferPool buffer_pool;
+	DatagramBatch *dgram_batch;
+	unsigned dgram_batch_size;
+	TimerWheel *timer_wheel;
+	WorkCompletionQueue *completions;
+	SizeClassArena *arena;
+	int wakeup_fd;
+	SocketHandler wakeup_handler;
+	volatile bool stop_requested;
+
+	static const unsigned DEFAULT_IO_BUDGET = 16;
+	static const size_t DEFAULT_RX_BUFFER_SIZE = 4096;
+	static const size_t INITIAL_BUFFER_POOL_SIZE = 4;
+	static const unsigned DEFAULT_DATAGRAM_BATCH_SIZE = 64;
 
 	static const size_t STRERR_BUF_SIZE = 64;
 	char strerror_buf[STRERR_BUF_SIZE];
@@ -0,0 +1,178 @@
+/**
+******************************************************************************
+* @file    sock_server_group.cpp
+*****************************************************************************/
+
+#include <signal.h>
+#include "sock_server_group.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+**
+*/
+SocketServerGroup::SocketServerGroup(unsigned const count, IOEventManager::backend_type const backend):
+	reactors(count ? count : 1),
+	backend(backend),
+	factory(0),
+	running(false),
+	started(0),
+	failed(0)
+{
+	pthread_mutex_init(&startup_mutex, 0);
+	pthread_cond_init(&startup_cond, 0);
+	for (unsigned i = 0; i < reactors.size(); i++) {
+		reactors[i].group = this;
+		reactors[i].index = i;
+		reactors[i].server = 0;
+		reactors[i].listener = 0;
+		reactors[i].thread_created = false;
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+SocketServerGroup::~SocketServerGroup()
+{
+	stop();
+	pthread_cond_destroy(&startup_cond);
+	pthread_mutex_destroy(&startup_mutex);
+}
+
+
+/*************************************************************************//**
+** Create the reactor threads and wait until all of them have registered
+** their listener.
+** @return 0 on success, -1 if some reactor failed (all are stopped)
+*/
+int SocketServerGroup::start(ListenerFactory * const listener_factory)
+{
+	if ((listener_factory == 0) || running)
+		return -1;
+
+	factory = listener_factory;
+	running = true;
+	started = failed = 0;
+
+	for (unsigned i = 0; i < reactors.size(); i++) {
+		int res = pthread_create(&reactors[i].thread, NULL, reactor_thread, &reactors[i]);
+		if (res != 0) {
+			_ERROR() << "cannot create reactor thread " << i;
+			startup_done(false);
+			continue;
+		}
+		reactors[i].thread_created = true;
+	}
+
+	pthread_mutex_lock(&startup_mutex);
+	while (started + failed < reactors.size())
+		pthread_cond_wait(&startup_cond, &startup_mutex);
+	bool const success = (failed == 0);
+	pthread_mutex_unlock(&startup_mutex);
+
+	if (!success) {
+		stop();
+		return -1;
+	}
+	_VBL(1) << "SocketServerGroup started " << reactors.size() << " reactors";
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Stop and join all reactor threads; servers and listeners are deleted
+*/
+void SocketServerGroup::stop()
+{
+	running = false;
+	pthread_mutex_lock(&startup_mutex);
+	for (unsigned i = 0; i < reactors.size(); i++)
+		if (reactors[i].server != 0)
+			reactors[i].server->stop();
+	pthread_mutex_unlock(&startup_mutex);
+
+	for (unsigned i = 0; i < reactors.size(); i++) {
+		if (reactors[i].thread_created) {
+			pthread_join(reactors[i].thread, 0);
+			reactors[i].thread_created = false;
+		}
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+void SocketServerGroup::startup_done(bool const success)
+{
+	pthread_mutex_lock(&startup_mutex);
+	if (success)
+		started++;
+	else
+		failed++;
+	pthread_cond_signal(&startup_cond);
+	pthread_mutex_unlock(&startup_mutex);
+}
+
+
+/*************************************************************************//**
+** Build the reactor on its own thread, so that the server (and the memory
+** it allocates) belongs to the thread that runs it.
+*/
+int SocketServerGroup::setup_reactor(reactor * const r)
+{
+	SocketServer * const server = new SocketServer(backend);
+	server->set_reuse_port(true);
+	pthread_mutex_lock(&startup_mutex);
+	r->server = server;
+	pthread_mutex_unlock(&startup_mutex);
+
+	r->listener = factory->create_listener(r->server, r->index);
+	if (r->listener == 0) {
+		_ERROR() << "reactor " << r->index << " has no listener";
+		return -1;
+	}
+	if (r->server->add_handler(r->listener) < 0) {
+		_ERROR() << "reactor " << r->index << " cannot register its listener";
+		return -1;
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void * SocketServerGroup::reactor_thread(void * const arg)
+{
+	reactor * const r = static_cast<reactor *>(arg);
+	SocketServerGroup * const group = r->group;
+
+	// Signals are handled by the main thread only
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, NULL);
+
+	_VBL(1) << "reactor " << r->index << " thread started ID:" << HEX(pthread_self(), sizeof(pthread_t)*2);
+
+	bool const ok = (group->setup_reactor(r) == 0);
+	group->startup_done(ok);
+
+	if (ok)
+		r->server->run();
+
+	// Hidden from stop() before going away. Deleting the server closes
+	// every socket it still owns.
+	pthread_mutex_lock(&group->startup_mutex);
+	SocketServer * const server = r->server;
+	r->server = 0;
+	pthread_mutex_unlock(&group->startup_mutex);
+	delete server;
+	delete r->listener;
+	r->listener = 0;
+	return 0;
+}
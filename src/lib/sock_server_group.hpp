@@ -0,0 +1,109 @@
+/**
+******************************************************************************
+* @file    sock_server_group.hpp
+* @brief   A set of SocketServer reactors, each running on its own thread
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __SOCK_SERVER_GROUP_HPP_INCLUDED
+#define __SOCK_SERVER_GROUP_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error sock_server_group.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <vector>
+#include "sock_server.hpp"
+
+using namespace std;
+
+
+/*************************************************************************//**
+**
+** Runs N reactor threads, each owning a SocketServer (and so its own epoll
+** set or io_uring instance). Every reactor gets its own listening handler, created by the
+** factory, whose service is bound with SO_REUSEPORT: the kernel balances
+** incoming connections among the listening sockets, and each connection
+** is then served entirely by the reactor that accepted it.
+**
+*****************************************************************************/
+
+class SocketServerGroup
+{
+public:
+	class ListenerFactory {
+	public:
+		virtual ~ListenerFactory()
+		{}
+		/**
+		 * Create the listening handler for reactor @a index. Called on the
+		 * reactor thread; the handler is owned (and deleted) by the group.
+		 */
+		virtual SocketHandler * create_listener(SocketServer * server, unsigned index) = 0;
+	};
+
+public:
+	SocketServerGroup(unsigned reactors,
+					  IOEventManager::backend_type backend = IOEventManager::BACKEND_EPOLL);
+	virtual ~SocketServerGroup();
+
+	int start(ListenerFactory * factory);
+	void stop();
+
+	unsigned get_size() const {
+		return reactors.size();
+	}
+	SocketServer * get_server(unsigned const index) const {
+		return (index < reactors.size()) ? reactors[index].server : 0;
+	}
+
+private:
+	struct reactor {
+		SocketServerGroup * group;
+		unsigned index;
+		SocketServer * server;
+		SocketHandler * listener;
+		pthread_t thread;
+		bool thread_created;
+	};
+
+	static void * reactor_thread(void * arg);
+	int setup_reactor(reactor * r);
+	void startup_done(bool success);
+
+private:
+	vector<reactor> reactors;
+	IOEventManager::backend_type backend;
+	ListenerFactory * factory;
+	volatile bool running;
+
+	pthread_mutex_t startup_mutex; // Also guards reactor::server for stop()
+	pthread_cond_t startup_cond;
+	unsigned started;
+	unsigned failed;
+};
+
+
+/****************************************************************************/
+
+#endif /* __SOCK_SERVER_GROUP_HPP_INCLUDED */
+/* EOF */
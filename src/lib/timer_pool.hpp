@@ -1,7 +1,7 @@
 /**
 ******************************************************************************
 * @file    timer_pool.hpp
-* @brief   A class that initialize and manages a collection of rt timers
+* @brief   A class that initialize and manages a collection of timers
 *
 * @author  
 * @version V1.0.0
@@ -32,8 +32,8 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #include <time.h>
-#include <signal.h>
 #include <pool_allocator.hpp>
+#include "timer_wheel.hpp"
 
 #include <logging.hpp>
 #include "typedumpers.hpp"
@@ -48,18 +48,34 @@ typedef void * aptimer_t;
 
 template <class T>
 struct timer_block {
-	timer_block() {} // Override default constructor
+	timer_block() { // Override default constructor
+		node.next = node.prev = 0; // Overwritten by the pool free list
+	}
+	timer_block(void (T::*func)(), T * const target, bool const oneshot):
+		timer_func(func),
+		instance(target),
+		active(false),
+		one_shot(oneshot)
+	{
+		node.next = node.prev = 0;
+		node.on_expiry = 0;
+	}
 	~timer_block() { // Invalidate function pointer
 		timer_func = 0;
+		active = false;
 	}
 
+	timer_node node; // First member: the wheel hands it back on expiry
 	void (T::*timer_func)();
 	T * instance;
 	bool active;
 	bool one_shot;
-	timer_t timer_handle;
 };
 
+/*************************************************************************//**
+** Timers of a SocketServer's TimerWheel calling back methods of a target
+** instance. Callbacks run on the server thread, from its event loop.
+*/
 template <class T>
 class TimerPool : public PoolAllocator< timer_block<T> >
 {
@@ -71,35 +87,31 @@ private:
 public:
 	TimerPool(size_t const slab_count):
 		TimerPoolAllocator(slab_count),
-		signal(-1)
-	{}
+		wheel(0),
+		target(0)
+	{
+		this->set_pool_name("timers");
+	}
 	
 	~TimerPool() {
-		timer_block_t * p = this->get_first();
-		while (p != 0) {
-			if (p->timer_handle) {
-				_VBL(2) << "destructor @" << this << " timer_delete " << p->timer_handle;
-				timer_delete(p->timer_handle);
-			}
-			p = this->get_next(p);
+		if (wheel == 0)
+			return;
+		// Allocated blocks only: stopping an unlinked node does nothing
+		for (timer_block_t * p = this->get_first(); p != 0; p = this->get_next(p)) {
+			_VBL(2) << "destructor @" << this << " stop " << p;
+			wheel->stop(&p->node);
 		}
 	}
 
-	int initialize(int const sig, T * const target_instance) {
-		timer_block_t * p = this->get_first();
-		signal = sig;
-		while (p != 0) {
-			if (create_timer(&p->timer_handle, sig, p) != 0)
-				return -1;
-			p->instance = target_instance;
-			p->active = false;
-			p = this->get_next(p);
+	int initialize(SocketServer * const server, T * const target_instance) {
+		wheel = server->get_timer_wheel();
+		if (wheel == 0) {
+			_ERROR() << "TimerPool @" << this << " no timer wheel";
+			return -1;
 		}
+		target = target_instance;
 		return 0;
 	}
-	int get_signal() const {
-		return signal;
-	}
 
 	aptimer_t start_oneshot(timespec * const it, CallbackMethod const func) {
 		return start(it, func, false);
@@ -116,37 +128,23 @@ public:
 
 	void stop(aptimer_t handle) {
 		timer_block_t * tb = reinterpret_cast<timer_block_t*>(handle);
-		timespec ts = {0, 0};
-		_VBL(2) << "TimerPool @" << this << " stop " << tb << " (" << (tb ? tb->timer_handle : 0) << ")";
-		if (set_time(tb, &ts, true) == 0)
+		_VBL(2) << "TimerPool @" << this << " stop " << tb;
+		if (tb != 0) {
+			wheel->stop(&tb->node);
 			tb->active = false;
-// 		if (set_time(tb, &ts, true) == 0)
-// 			this->free_object(tb);
+		}
 	}
 
 	void release(aptimer_t &handle) {
 		timer_block_t * tb = reinterpret_cast<timer_block_t*>(handle);
-		_VBL(2) << "TimerPool @" << this << " release " << tb << " (" << (tb ? tb->timer_handle : 0) << ")";
+		_VBL(2) << "TimerPool @" << this << " release " << tb;
 		if (tb != 0) {
+			wheel->stop(&tb->node);
 			this->free_object(tb);
 			handle = 0;
 		}
 	}
 
-	static void call_handler(aptimer_t const h) {
-		timer_block_t *tb = reinterpret_cast<timer_block_t*>(h);
-		_VBL(3) << "TimerPool call_handler @" << tb <<
-		                         " handle @" << (tb ? tb->timer_handle : 0) <<
-		                         " instance @" << (tb ? tb->instance : 0);
-		if (tb != 0) {
-			if (tb->active == false)
-				_WARNING() << "Signal on inactive timer block " << tb;
-			else
-			if (tb->timer_func != 0)
-				(*tb->instance.*tb->timer_func)();
-		}
-	}
-
 	static T * get_target_instance(aptimer_t const h) {
 		timer_block_t *tb = reinterpret_cast<timer_block_t*>(h);
 		if (tb != 0)
@@ -162,91 +160,49 @@ public:
 	}
 
 protected:
-	int create_timer(timer_t * handle, int const timers_signal, void * const uptr)
-	{
-		struct sigevent sev;
-		sev.sigev_notify = SIGEV_SIGNAL;
-		sev.sigev_signo = timers_signal;
-		sev.sigev_value.sival_ptr = uptr;
-
-		unsigned retry = 10;
-		while (retry--) {
-			int res = timer_create(CLOCK_MONOTONIC, &sev, handle);
-			if (res == -1) {
-				if (errno == EAGAIN) {
-					struct timespec ts = {0, 50000000}; // 50ms
-					nanosleep(&ts, 0);
-				} else {
-					_LSYSERROR_INST("timer_create failed");
-					return -1;
-				}
-			} else {
-				_VBL(2) << "TimerPool @" << this << " create_timer " << *handle;
-				return 0;
-			}
-		}
-		return -1;
+	// Double the capacity in a new chunk: running timers are linked in the
+	// wheel by address and must not move. A block only becomes a timer
+	// when started, so the pool size costs memory and nothing else.
+	void grow_pool() {
+		this->add_chunk(this->get_pool_size() ? this->get_pool_size() : 4);
+	}
+	void trim_pool() {
+		this->trim_idle_chunks();
 	}
 
-	int set_time(timer_block_t * h, timespec * const it, bool const periodic) {
-		/* Tolerate null handler */
-		if (h == 0)
-			return -1;
-		/* Setup itimerspec structure according to timer mode */
-		struct itimerspec its;
-		its.it_value = *it;
-		if (periodic)
-			its.it_interval = *it;
-		else {
-			its.it_interval.tv_sec = 0;
-			its.it_interval.tv_nsec = 0;
-		}
-		/* Start the timer */
-		if (timer_settime(h->timer_handle, 0, &its, NULL) == -1) {
-			_LSYSERROR_INST("timer_settime failed");
-			return -1;
-		}
-		_VBL(2) << "TimerPool @" << this << " set_time " << h << " " << its;
-		return 0;
+	static void on_expiry(timer_node * const node) {
+		timer_block_t * const tb = reinterpret_cast<timer_block_t*>(node);
+		_VBL(3) << "TimerPool on_expiry @" << tb << " instance @" << tb->instance;
+		if (tb->one_shot)
+			tb->active = false;
+		if (tb->timer_func != 0)
+			(*tb->instance.*tb->timer_func)();
 	}
-	
-	aptimer_t start(timespec * const it, CallbackMethod const func, bool const periodic) {
-		timer_block_t * h = this->alloc_object();
+
+	aptimer_t start(uint64_t const ticks, CallbackMethod const func, bool const periodic) {
+		if (wheel == 0)
+			return 0;
+		timer_block_t * h = this->emplace(func, target, !periodic);
 		if (h != 0) {
-			h->timer_func = func;
-			h->one_shot = !periodic;
-			if (set_time(h, it, periodic) == 0)
-				h->active = true;
+			h->node.on_expiry = &on_expiry;
+			wheel->start(&h->node, ticks, periodic);
+			h->active = true;
+			_VBL(2) << "TimerPool @" << this << " start " << h << " ticks:" << ticks;
 		}
 		return h;
 	}
-	
-	aptimer_t start(int const msec, CallbackMethod const func, bool const periodic) {
-		timer_block_t * h = this->alloc_object();
-		if (h != 0) {
-			ldiv_t dt = ldiv(msec, 1000);
-			timespec it = {dt.quot, dt.rem * 1000000};
-			h->timer_func = func;
-			h->one_shot = !periodic;
-			if (set_time(h, &it, periodic) == 0)
-				h->active = true;
-		}
-		return h;
+
+	aptimer_t start(timespec * const it, CallbackMethod const func, bool const periodic) {
+		return start(wheel ? wheel->to_ticks(it) : 0, func, periodic);
 	}
 
-	static bool is_timer_elapsed(timer_t timer) {
-		struct itimerspec itv;
-		if (timer_gettime(timer, &itv) == -1) {
-			_LSYSERROR("is_timer_elapsed timer_gettime failed");
-			return true;
-		} else {
-			_VBL(2) << "is_timer_elapsed itv:" << itv;
-			return ((itv.it_value.tv_sec == 0) || (itv.it_value.tv_nsec == 0));
-		}
+	aptimer_t start(int const msec, CallbackMethod const func, bool const periodic) {
+		return start(wheel ? wheel->to_ticks((unsigned)msec) : 0, func, periodic);
 	}
 
 private:
-	int signal;
+	TimerWheel * wheel;
+	T * target;
 };
 
 
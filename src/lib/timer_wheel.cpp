@@ -0,0 +1,336 @@
+/**
+******************************************************************************
+* @file    timer_wheel.cpp
+*****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "timer_wheel.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "timers"
+
+
+/*************************************************************************//**
+**
+*/
+TimerWheel::TimerWheel(SocketServer * const server, unsigned const tick_us):
+	SocketHandler(server),
+	timer_fd(-1),
+	tick_ns((tick_us ? tick_us : 1) * 1000ULL),
+	current(0),
+	armed(NEVER),
+	count(0)
+{
+	for (unsigned l = 0; l < LEVELS; l++)
+		for (unsigned i = 0; i < SLOTS; i++)
+			slots[l][i].next = slots[l][i].prev = &slots[l][i];
+	memset(bitmap, 0, sizeof(bitmap));
+	clock_gettime(CLOCK_MONOTONIC, &origin);
+
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer_fd < 0) {
+		_LSYSERROR("timerfd_create error");
+		return;
+	}
+	if (server->add_event_fd(this, timer_fd) != 0) {
+		_ERROR() << "cannot register timer wheel fd " << timer_fd;
+		close(timer_fd);
+		timer_fd = -1;
+	}
+}
+
+
+/*************************************************************************//**
+** Timers still linked are simply forgotten: their owners release them.
+*/
+TimerWheel::~TimerWheel()
+{
+	if (timer_fd >= 0) {
+		get_server()->rem_fd(timer_fd);
+		close(timer_fd);
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+uint64_t TimerWheel::now_ticks() const
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int64_t const ns = (int64_t)(now.tv_sec - origin.tv_sec) * 1000000000LL +
+					   (now.tv_nsec - origin.tv_nsec);
+	return (ns > 0) ? (uint64_t)ns / tick_ns : 0;
+}
+
+
+/*************************************************************************//**
+** Interval to ticks, rounded up
+*/
+uint64_t TimerWheel::to_ticks(struct timespec const * const ts) const
+{
+	uint64_t const ns = (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+	return (ns + tick_ns - 1) / tick_ns;
+}
+
+
+uint64_t TimerWheel::to_ticks(unsigned const msec) const
+{
+	return ((uint64_t)msec * 1000000ULL + tick_ns - 1) / tick_ns;
+}
+
+
+/*************************************************************************//**
+** Link @a node in the slot matching its expiry: the lowest level whose
+** range covers the remaining time
+*/
+void TimerWheel::insert(timer_node * const node)
+{
+	// Cascaded timers may be due on the current tick, whose slot is run
+	// right after the cascade
+	uint64_t expires = node->expires;
+	if (expires < current)
+		expires = current;
+
+	uint64_t const delta = expires - current;
+	unsigned level = 0;
+	while ((level < LEVELS - 1) && (delta >= (1ULL << (SLOT_BITS * (level + 1)))))
+		level++;
+	// Beyond the wheel range: park in the last slot reachable, the timer
+	// is placed again when that slot is cascaded
+	if (delta >= (1ULL << (SLOT_BITS * LEVELS)))
+		expires = current + (1ULL << (SLOT_BITS * LEVELS)) - 1;
+
+	unsigned const idx = (expires >> (SLOT_BITS * level)) & SLOT_MASK;
+	timer_link * const head = &slots[level][idx];
+	node->next = head;
+	node->prev = head->prev;
+	head->prev->next = node;
+	head->prev = node;
+	node->slot = level * SLOTS + idx;
+	bitmap[level][idx / 64] |= 1ULL << (idx % 64);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void TimerWheel::unlink(timer_node * const node)
+{
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->next = node->prev = 0;
+
+	if (node->slot != NO_SLOT) {
+		unsigned const level = node->slot / SLOTS;
+		unsigned const idx = node->slot % SLOTS;
+		if (slots[level][idx].next == &slots[level][idx])
+			bitmap[level][idx / 64] &= ~(1ULL << (idx % 64));
+	}
+}
+
+
+/*************************************************************************//**
+** Move all the timers of a slot to @a list (a sentinel)
+*/
+void TimerWheel::detach_slot(unsigned const level, unsigned const idx, timer_link * const list)
+{
+	timer_link * const head = &slots[level][idx];
+	if (head->next == head) {
+		list->next = list->prev = list;
+		return;
+	}
+	list->next = head->next;
+	list->prev = head->prev;
+	list->next->prev = list;
+	list->prev->next = list;
+	head->next = head->prev = head;
+	bitmap[level][idx / 64] &= ~(1ULL << (idx % 64));
+
+	for (timer_link * l = list->next; l != list; l = l->next)
+		static_cast<timer_node *>(l)->slot = NO_SLOT;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void TimerWheel::cascade(unsigned const level, unsigned const idx)
+{
+	timer_link list;
+	detach_slot(level, idx, &list);
+	while (list.next != &list) {
+		timer_node * const node = static_cast<timer_node *>(list.next);
+		unlink(node);
+		insert(node);
+	}
+}
+
+
+/*************************************************************************//**
+** Run the timers of level 0 slot @a idx. The slot is detached first, so
+** that callbacks may freely start and stop timers, including the ones
+** about to run.
+*/
+void TimerWheel::expire(unsigned const idx)
+{
+	timer_link list;
+	detach_slot(0, idx, &list);
+	while (list.next != &list) {
+		timer_node * const node = static_cast<timer_node *>(list.next);
+		unlink(node);
+		if (node->period != 0) {
+			node->expires += node->period;
+			if (node->expires <= current)
+				node->expires = current + node->period; // Overrun: skip
+			insert(node);
+		} else
+			count--;
+		node->on_expiry(node);
+	}
+}
+
+
+/*************************************************************************//**
+** First occupied slot of @a level at or after @a from, -1 if none
+*/
+int TimerWheel::next_slot(unsigned const level, unsigned const from) const
+{
+	for (unsigned w = from / 64; w < BITMAP_WORDS; w++) {
+		uint64_t bits = bitmap[level][w];
+		if (w == from / 64)
+			bits &= ~0ULL << (from % 64);
+		if (bits != 0)
+			return w * 64 + __builtin_ctzll(bits);
+	}
+	return -1;
+}
+
+
+bool TimerWheel::level_empty(unsigned const level) const
+{
+	for (unsigned w = 0; w < BITMAP_WORDS; w++)
+		if (bitmap[level][w] != 0)
+			return false;
+	return true;
+}
+
+
+/*************************************************************************//**
+** Next tick having something to do: a level 0 slot to run, or a slot of
+** an upper level to cascade. Slots behind the current position of their
+** level are only reached after the level wraps around.
+*/
+uint64_t TimerWheel::next_tick() const
+{
+	for (unsigned level = 0; level < LEVELS; level++) {
+		unsigned const shift = SLOT_BITS * level;
+		unsigned const pos = (current >> shift) & SLOT_MASK;
+		int const s = (pos < SLOT_MASK) ? next_slot(level, pos + 1) : -1;
+		if (s >= 0)
+			return ((current >> shift) - pos + s) << shift;
+		if (!level_empty(level))
+			return ((current >> (shift + SLOT_BITS)) + 1) << (shift + SLOT_BITS);
+	}
+	return NEVER;
+}
+
+
+/*************************************************************************//**
+** Process all ticks up to @a to, jumping over those with nothing to do
+*/
+void TimerWheel::advance(uint64_t const to)
+{
+	while (current < to) {
+		uint64_t const t = (count != 0) ? next_tick() : NEVER;
+		if (t > to) {
+			current = to;
+			break;
+		}
+		current = t;
+		if ((current & SLOT_MASK) == 0) {
+			for (unsigned level = 1; level < LEVELS; level++) {
+				unsigned const idx = (current >> (SLOT_BITS * level)) & SLOT_MASK;
+				cascade(level, idx);
+				if (idx != 0)
+					break;
+			}
+		}
+		expire(current & SLOT_MASK);
+	}
+}
+
+
+/*************************************************************************//**
+** Arm the timerfd for the next tick to process, disarm it if no timer is
+** running
+*/
+void TimerWheel::rearm()
+{
+	uint64_t const t = (count != 0) ? next_tick() : NEVER;
+	if (t == armed)
+		return;
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	if (t != NEVER) {
+		uint64_t const ns = origin.tv_nsec + t * tick_ns;
+		its.it_value.tv_sec = origin.tv_sec + ns / 1000000000ULL;
+		its.it_value.tv_nsec = ns % 1000000000ULL;
+	}
+	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, 0) < 0) {
+		_LSYSERROR("timerfd_settime error");
+		return;
+	}
+	armed = t;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void TimerWheel::start(timer_node * const node, uint64_t const ticks, bool const periodic)
+{
+	if (is_linked(node))
+		stop(node);
+
+	uint64_t const now = now_ticks();
+	// An idle wheel catches up without walking the elapsed ticks
+	if ((count == 0) && (current < now))
+		current = now;
+
+	node->expires = now + (ticks ? ticks : 1);
+	node->period = periodic ? (ticks ? ticks : 1) : 0;
+	insert(node);
+	count++;
+	rearm();
+}
+
+
+/*************************************************************************//**
+** The timerfd may stay armed for the stopped timer: the wakeup finds
+** nothing to do and arms it again
+*/
+void TimerWheel::stop(timer_node * const node)
+{
+	if (!is_linked(node))
+		return;
+	unlink(node);
+	count--;
+}
+
+
+/*************************************************************************//**
+** The timerfd expired
+*/
+int TimerWheel::on_event(int, uint64_t)
+{
+	armed = NEVER;
+	advance(now_ticks());
+	rearm();
+	return 0;
+}
@@ -0,0 +1,144 @@
+/**
+******************************************************************************
+* @file    timer_wheel.hpp
+* @brief   Hierarchical hashed timer wheel driven by a timerfd
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __TIMER_WHEEL_HPP_INCLUDED
+#define __TIMER_WHEEL_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error timer_wheel.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <time.h>
+#include "sock_server.hpp"
+
+
+/*************************************************************************//**
+** Timer linked in the wheel. Embedded in the owner's structure, the wheel
+** never allocates.
+*/
+struct timer_link {
+	timer_link * next;
+	timer_link * prev;
+};
+
+struct timer_node : timer_link {
+	typedef void (*expiry_func)(timer_node *);
+
+	uint64_t expires;      // Tick
+	uint64_t period;       // Ticks, 0 for one shot timers
+	uint16_t slot;         // Wheel slot while linked
+	expiry_func on_expiry;
+};
+
+
+/*************************************************************************//**
+**
+** Four levels of 256 slots: level 0 holds the timers due within 256 ticks,
+** one slot per tick; each further level covers 256 times the range of the
+** previous one and its slots are redistributed (cascaded) to the lower
+** levels as time reaches them. Starting and stopping a timer is a list
+** insertion or removal.
+**
+** A single timerfd, registered in the server's event manager, is armed
+** for the next tick having something to do (found through the per level
+** occupancy bitmaps), so an idle wheel causes no wakeups.
+**
+** Timers run on the server thread: start and stop them from that thread
+** only.
+**
+*****************************************************************************/
+
+class TimerWheel : public SocketHandler
+{
+public:
+	static const unsigned DEFAULT_TICK_US = 1000;
+
+	TimerWheel(SocketServer * server, unsigned tick_us = DEFAULT_TICK_US);
+	virtual ~TimerWheel();
+
+	bool is_ready() const {
+		return timer_fd >= 0;
+	}
+
+	/**
+	 * (Re)start @a node, expiring after @a ticks (at least 1); periodic
+	 * timers are restarted with the same interval on expiry, before their
+	 * callback runs
+	 */
+	void start(timer_node * node, uint64_t ticks, bool periodic);
+	void stop(timer_node * node);
+
+	static bool is_linked(timer_node const * const node) {
+		return node->next != 0;
+	}
+
+	uint64_t to_ticks(struct timespec const * ts) const;
+	uint64_t to_ticks(unsigned msec) const;
+
+	unsigned get_count() const {
+		return count;
+	}
+
+	int on_event(int fd, uint64_t expirations);
+
+private:
+	static const unsigned LEVELS = 4;
+	static const unsigned SLOT_BITS = 8;
+	static const unsigned SLOTS = 1 << SLOT_BITS;
+	static const unsigned SLOT_MASK = SLOTS - 1;
+	static const unsigned BITMAP_WORDS = SLOTS / 64;
+	static const uint16_t NO_SLOT = 0xFFFF;
+	static const uint64_t NEVER = ~(uint64_t)0;
+
+	uint64_t now_ticks() const;
+	void insert(timer_node * node);
+	void unlink(timer_node * node);
+	void detach_slot(unsigned level, unsigned idx, timer_link * list);
+	void cascade(unsigned level, unsigned idx);
+	void expire(unsigned idx);
+	void advance(uint64_t to);
+	int next_slot(unsigned level, unsigned from) const;
+	bool level_empty(unsigned level) const;
+	uint64_t next_tick() const;
+	void rearm();
+
+private:
+	int timer_fd;
+	uint64_t tick_ns;
+	struct timespec origin;
+	uint64_t current;
+	uint64_t armed;
+	unsigned count;
+
+	timer_link slots[LEVELS][SLOTS];
+	uint64_t bitmap[LEVELS][BITMAP_WORDS];
+};
+
+
+/****************************************************************************/
+
+#endif /* __TIMER_WHEEL_HPP_INCLUDED */
+/* EOF */
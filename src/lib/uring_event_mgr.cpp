@@ -0,0 +1,720 @@
+/**
+******************************************************************************
+* @file    uring_event_mgr.cpp
+*****************************************************************************/
+
+#include "uring_event_mgr.hpp"
+
+#ifdef HAVE_IO_URING
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+/*************************************************************************//**
+** System call wrappers (no glibc support)
+*/
+static inline int _io_uring_setup(unsigned const entries, struct io_uring_params * const p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int _io_uring_enter(int const fd, unsigned const to_submit, unsigned const min_complete,
+								  unsigned const flags, void * const arg, size_t const argsz)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+static inline int _io_uring_register(int const fd, unsigned const opcode, void * const arg, unsigned const nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+/*************************************************************************//**
+**
+*/
+URingEventManager::URingEventManager(unsigned const initial_size,
+									 unsigned const rx_buffers, unsigned const rx_buffer_size):
+	IOEventManager(initial_size),
+	ring_fd(-1),
+	sq_ring_ptr(MAP_FAILED),
+	sq_ring_size(0),
+	cq_ring_ptr(MAP_FAILED),
+	cq_ring_size(0),
+	sqes_size(0),
+	buf_ring(0),
+	buf_ring_size(0),
+	buf_base(0),
+	buf_count(0),
+	buf_size(0),
+	buf_tail(0),
+	event_index(0)
+{
+	sqes = 0;
+	sqe_tail = 0;
+	if (setup_ring(RING_ENTRIES) < 0)
+		return;
+	if (probe_support() < 0) {
+		close(ring_fd);
+		ring_fd = -1;
+		return;
+	}
+	if (setup_buffers(rx_buffers, rx_buffer_size) < 0) {
+		close(ring_fd);
+		ring_fd = -1;
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+URingEventManager::~URingEventManager()
+{
+	// Closing the ring cancels whatever is still in flight
+	if (ring_fd >= 0)
+		close(ring_fd);
+	if (buf_ring != 0)
+		munmap(buf_ring, buf_ring_size);
+	free(buf_base);
+	if (sqes != 0)
+		munmap(sqes, sqes_size);
+	if ((cq_ring_ptr != MAP_FAILED) && (cq_ring_ptr != sq_ring_ptr))
+		munmap(cq_ring_ptr, cq_ring_size);
+	if (sq_ring_ptr != MAP_FAILED)
+		munmap(sq_ring_ptr, sq_ring_size);
+}
+
+
+/*************************************************************************//**
+** Create the ring and map the submission and completion queues
+*/
+int URingEventManager::setup_ring(unsigned const entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	ring_fd = _io_uring_setup(entries, &p);
+	if (ring_fd < 0) {
+		_LSYSERROR("io_uring_setup error");
+		return -1;
+	}
+	if ((p.features & IORING_FEAT_EXT_ARG) == 0) {
+		_ERROR() << "io_uring: kernel too old (no IORING_FEAT_EXT_ARG)";
+		return -1;
+	}
+
+	sq_entries = p.sq_entries;
+	sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (cq_ring_size > sq_ring_size)
+			sq_ring_size = cq_ring_size;
+		cq_ring_size = sq_ring_size;
+	}
+
+	sq_ring_ptr = mmap(0, sq_ring_size, PROT_READ | PROT_WRITE,
+					   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	if (sq_ring_ptr == MAP_FAILED) {
+		_LSYSERROR("io_uring sq ring mmap error");
+		return -1;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq_ring_ptr = sq_ring_ptr;
+	else {
+		cq_ring_ptr = mmap(0, cq_ring_size, PROT_READ | PROT_WRITE,
+						   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		if (cq_ring_ptr == MAP_FAILED) {
+			_LSYSERROR("io_uring cq ring mmap error");
+			return -1;
+		}
+	}
+
+	sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	void * const s = mmap(0, sqes_size, PROT_READ | PROT_WRITE,
+						  MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+	if (s == MAP_FAILED) {
+		_LSYSERROR("io_uring sqes mmap error");
+		return -1;
+	}
+	sqes = (struct io_uring_sqe *)s;
+
+	uint8_t * const sq = (uint8_t *)sq_ring_ptr;
+	sq_head  = (unsigned *)(sq + p.sq_off.head);
+	sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+	sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+	sq_array = (unsigned *)(sq + p.sq_off.array);
+	sqe_tail = *sq_tail;
+
+	uint8_t * const cq = (uint8_t *)cq_ring_ptr;
+	cq_head = (unsigned *)(cq + p.cq_off.head);
+	cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	_VBL(2) << "io_uring ready, sq:" << p.sq_entries << " cq:" << p.cq_entries;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** The kernel must know the operations used, and their multishot variants:
+** the probe only tells about the opcodes, the multishot flags of accept
+** (5.19) and recv (6.0) are told by the kernel version.
+*/
+int URingEventManager::probe_support()
+{
+	static const uint8_t required[] = {
+		IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL
+	};
+
+	size_t const size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+	struct io_uring_probe * const probe = (struct io_uring_probe *)calloc(1, size);
+	if (probe == 0)
+		return -1;
+	int error = 0;
+	if (_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+		_LSYSERROR("io_uring probe error");
+		error = -1;
+	} else {
+		for (size_t i = 0; i < sizeof(required) / sizeof(required[0]); i++) {
+			uint8_t const op = required[i];
+			if ((op > probe->last_op) || ((probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)) {
+				_ERROR() << "io_uring: opcode " << (unsigned)op << " not supported";
+				error = -1;
+			}
+		}
+	}
+	free(probe);
+	if (error != 0)
+		return error;
+
+	struct utsname u;
+	unsigned major = 0;
+	unsigned minor = 0;
+	if ((uname(&u) != 0) || (sscanf(u.release, "%u.%u", &major, &minor) != 2)) {
+		_ERROR() << "io_uring: cannot tell the kernel version";
+		return -1;
+	}
+	if ((major < MIN_KERNEL_MAJOR) || ((major == MIN_KERNEL_MAJOR) && (minor < MIN_KERNEL_MINOR))) {
+		_ERROR() << "io_uring: kernel " << u.release << " too old for multishot recv, "
+				 << (unsigned)MIN_KERNEL_MAJOR << "." << (unsigned)MIN_KERNEL_MINOR << " required";
+		return -1;
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Register the ring of receive buffers the kernel picks from. @a count
+** must be a power of two.
+*/
+int URingEventManager::setup_buffers(unsigned const count, unsigned const size)
+{
+	if ((count == 0) || (count & (count - 1)) || (count > 32768) || (size == 0)) {
+		_ERROR() << "io_uring: invalid rx buffers " << count << "x" << size;
+		return -1;
+	}
+
+	buf_ring_size = count * sizeof(struct io_uring_buf);
+	void * const r = mmap(0, buf_ring_size, PROT_READ | PROT_WRITE,
+						  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r == MAP_FAILED) {
+		_LSYSERROR("io_uring buffer ring mmap error");
+		return -1;
+	}
+
+	memset(r, 0, buf_ring_size);
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)r;
+	reg.ring_entries = count;
+	reg.bgid = BUFFER_GROUP;
+	if (_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		_LSYSERROR("io_uring buffer ring registration error");
+		munmap(r, buf_ring_size);
+		return -1;
+	}
+
+	buf_base = (uint8_t *)malloc((size_t)count * size);
+	if (buf_base == 0) {
+		_ERROR() << "io_uring: rx buffers allocation error";
+		munmap(r, buf_ring_size);
+		return -1;
+	}
+	buf_ring = (struct io_uring_buf_ring *)r;
+	buf_count = count;
+	buf_size = size;
+	buf_tail = 0;
+	for (unsigned bid = 0; bid < count; bid++)
+		add_buffer(bid);
+	__atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Hand buffer @a bid (back) to the kernel; visible after the tail is
+** published
+*/
+void URingEventManager::add_buffer(unsigned const bid)
+{
+	// Not buf_ring->bufs: in C++ the empty struct __DECLARE_FLEX_ARRAY
+	// puts in front of it takes one byte, which shifts the array
+	struct io_uring_buf * const b = (struct io_uring_buf *)buf_ring + (buf_tail & (buf_count - 1));
+	b->addr = (uintptr_t)(buf_base + (size_t)bid * buf_size);
+	b->len = buf_size;
+	b->bid = bid;
+	buf_tail++;
+}
+
+
+/*************************************************************************//**
+** Next free submission queue entry, cleared. When the queue is full the
+** pending entries are submitted first.
+*/
+struct io_uring_sqe * URingEventManager::get_sqe()
+{
+	if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+		submit(0, 0);
+		if (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+			_ERROR() << "io_uring submission queue full";
+			return 0;
+		}
+	}
+	unsigned const idx = sqe_tail & *sq_mask;
+	struct io_uring_sqe * const sqe = &sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sq_array[idx] = idx;
+	sqe_tail++;
+	return sqe;
+}
+
+
+/*************************************************************************//**
+** Submit queued entries and, if @a wait_nr is not zero, wait for
+** completions up to @a tout.
+** @return as io_uring_enter(): -1 with errno set on error
+*/
+int URingEventManager::submit(unsigned const wait_nr, struct timespec const * const tout)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned flags = 0;
+	void * argp = 0;
+	size_t argsz = 0;
+
+	__atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+	unsigned const to_submit = sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+
+	if (wait_nr != 0) {
+		flags |= IORING_ENTER_GETEVENTS;
+		if (tout != 0) {
+			ts.tv_sec = tout->tv_sec;
+			ts.tv_nsec = tout->tv_nsec;
+			memset(&arg, 0, sizeof(arg));
+			arg.sigmask_sz = _NSIG / 8;
+			arg.ts = (uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			argp = &arg;
+			argsz = sizeof(arg);
+		}
+	} else
+	if (to_submit == 0)
+		return 0;
+
+	return _io_uring_enter(ring_fd, to_submit, wait_nr, flags, argp, argsz);
+}
+
+
+/*************************************************************************//**
+**
+*/
+unsigned URingEventManager::input_op(struct fddesc_info const * const fddi)
+{
+	if (fddi->flags & FDIF_LISTENING)
+		return OP_ACCEPT;
+	// Datagram sockets are left to the server, which drains them with
+	// recvmmsg and gets the peer addresses
+	if (fddi->flags & (FDIF_NONSOCKET | FDIF_DATAGRAM))
+		return OP_POLL;
+	return OP_RECV;
+}
+
+
+/*************************************************************************//**
+** Queue the request delivering the input events of a descriptor
+*/
+int URingEventManager::arm_input(struct fddesc_info * const fddi)
+{
+	struct io_uring_sqe * const sqe = get_sqe();
+	if (sqe == 0)
+		return -1;
+
+	unsigned const op = input_op(fddi);
+	sqe->fd = fddi->fd;
+	switch (op) {
+		case OP_ACCEPT:
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			break;
+		case OP_POLL:
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->poll32_events = fddi->events;
+			break;
+		default:
+			sqe->opcode = IORING_OP_RECV;
+			sqe->ioprio = IORING_RECV_MULTISHOT;
+			sqe->flags = IOSQE_BUFFER_SELECT;
+			sqe->buf_group = BUFFER_GROUP;
+			break;
+	}
+	sqe->user_data = (uintptr_t)fddi | op;
+	fddi->flags |= FDIF_IN_ARMED;
+	fddi->pending_ops++;
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int URingEventManager::arm_output(struct fddesc_info * const fddi)
+{
+	struct io_uring_sqe * const sqe = get_sqe();
+	if (sqe == 0)
+		return -1;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fddi->fd;
+	sqe->poll32_events = POLLOUT;
+	sqe->user_data = (uintptr_t)fddi | OP_POLL_OUT;
+	fddi->flags |= FDIF_OUT_ARMED;
+	fddi->pending_ops++;
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Cancel the request identified by @a user_data; the cancelled request
+** still posts a (last) completion
+*/
+int URingEventManager::cancel(uint64_t const user_data)
+{
+	struct io_uring_sqe * const sqe = get_sqe();
+	if (sqe == 0)
+		return -1;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = OP_CANCEL;
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int URingEventManager::add_fd(int const fd, uint32_t const events, void * const udata, uint32_t const flags)
+{
+	struct fddesc_info * fdd_info;
+
+	fdd_info = alloc_fddinfo(fd, events, udata, flags);
+	if (fdd_info == 0) {
+		_ERROR() << "no descriptor available for fd " << fd;
+		return -1;
+	}
+
+	if (arm_input(fdd_info) < 0) {
+		free_fddinfo(fdd_info);
+		return -1;
+	}
+	fddescs->bind_fd(fdd_info);
+
+	return 0;
+}
+
+
+/*************************************************************************//**
+** The descriptor stops being reported at once, but its memory is kept
+** until the kernel has posted the last completion of its requests.
+*/
+int URingEventManager::rem_fd(struct fddesc_info * const fddi)
+{
+	if ((fddi == 0) || ((fddi->flags & FDIF_VALID) == 0))
+		return -1;
+
+	if (fddi->flags & FDIF_IN_ARMED)
+		cancel((uintptr_t)fddi | input_op(fddi));
+	if (fddi->flags & FDIF_OUT_ARMED)
+		cancel((uintptr_t)fddi | OP_POLL_OUT);
+	// Submit now: the caller is about to close the descriptor
+	if (submit(0, 0) < 0)
+		_LSYSERROR("io_uring cancel submission error");
+
+	fddi->flags &= ~FDIF_VALID;
+	fddescs->unbind_fd(fddi);
+	released.push_back(fddi);
+
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+int URingEventManager::add_socket(int fd, void *udata, uint32_t flags)
+{
+	flags |= FDIF_VALID;
+
+	_VBL(3) <<  "fd:" << fd << " udata:" << udata <<
+				" svr:" << ((flags & FDIF_LISTENING) ? 'Y' : 'N') <<
+				" dgram:" << ((flags & FDIF_DATAGRAM) ? 'Y' : 'N');
+	return add_fd(fd, POLLIN | POLLPRI, udata, flags);
+}
+
+
+/*************************************************************************//**
+** A oneshot POLLOUT request is kept armed while output interest is on.
+** Disabling doesn't cancel it: its completion is just not reported.
+*/
+int URingEventManager::set_output_interest(int const fd, bool const enable)
+{
+	struct fddesc_info * const fdd_info = find_fddinfo(fd);
+	if (fdd_info == 0)
+		return -1;
+	if (((fdd_info->flags & FDIF_OUTPUT) != 0) == enable)
+		return 0;
+
+	if (!enable) {
+		fdd_info->flags &= ~FDIF_OUTPUT;
+		return 0;
+	}
+	fdd_info->flags |= FDIF_OUTPUT;
+	if (fdd_info->flags & FDIF_OUT_ARMED)
+		return 0;
+	return arm_output(fdd_info);
+}
+
+
+/*************************************************************************//**
+** Housekeeping between two batches, when handlers no longer reference
+** the previous one: give receive buffers back, re-arm the requests that
+** ended and release removed descriptors the kernel is done with.
+*/
+void URingEventManager::prepare_wait()
+{
+	if (!used_buffers.empty()) {
+		for (size_t i = 0; i < used_buffers.size(); i++)
+			add_buffer(used_buffers[i]);
+		__atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+		used_buffers.clear();
+	}
+
+	for (size_t i = 0; i < rearm.size(); i++) {
+		struct fddesc_info * const fddi = rearm[i];
+		if ((fddi->flags & FDIF_VALID) == 0)
+			continue;
+		if ((fddi->flags & FDIF_IN_ARMED) == 0)
+			arm_input(fddi);
+		if ((fddi->flags & (FDIF_OUTPUT | FDIF_OUT_ARMED)) == FDIF_OUTPUT)
+			arm_output(fddi);
+	}
+	rearm.clear();
+
+	size_t kept = 0;
+	for (size_t i = 0; i < released.size(); i++) {
+		if (released[i]->pending_ops == 0)
+			free_fddinfo(released[i]);
+		else
+			released[kept++] = released[i];
+	}
+	released.resize(kept);
+	fddescs->trim();
+
+	events.clear();
+	event_index = 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+struct IOEventManager::io_event &
+URingEventManager::push_event(struct fddesc_info * const fddi, uint32_t const ev_mask)
+{
+	struct io_event ev;
+	ev.fd = fddi->fd;
+	ev.events = ev_mask;
+	ev.flags = fddi->flags;
+	ev.udata = fddi->uptr;
+	ev.desc = fddi;
+	ev.accepted_fd = -1;
+	ev.rx_data = 0;
+	ev.rx_result = 0;
+	ev.rx_completed = false;
+	events.push_back(ev);
+	return events.back();
+}
+
+
+/*************************************************************************//**
+** Turn a completion into an event
+*/
+void URingEventManager::complete(uint64_t const user_data, int const res, uint32_t const cqe_flags)
+{
+	unsigned const op = user_data & OP_MASK;
+	struct fddesc_info * const fddi = (struct fddesc_info *)(uintptr_t)(user_data & ~OP_MASK);
+	bool const more = (cqe_flags & IORING_CQE_F_MORE) != 0;
+	bool const has_buffer = (cqe_flags & IORING_CQE_F_BUFFER) != 0;
+	unsigned const bid = cqe_flags >> IORING_CQE_BUFFER_SHIFT;
+
+	if (op == OP_CANCEL)
+		return;
+	if (has_buffer)
+		used_buffers.push_back(bid);
+	if (!more) {
+		fddi->pending_ops--;
+		fddi->flags &= ~((op == OP_POLL_OUT) ? FDIF_OUT_ARMED : FDIF_IN_ARMED);
+	}
+	if ((fddi->flags & FDIF_VALID) == 0) {
+		if ((op == OP_ACCEPT) && (res >= 0))
+			close(res);
+		return;
+	}
+
+	switch (op) {
+		case OP_ACCEPT:
+			if (res >= 0)
+				push_event(fddi, POLLIN).accepted_fd = res;
+			else
+			if (res != -ECANCELED) {
+				errno = -res;
+				_LSYSERROR("io_uring accept error");
+			}
+			break;
+
+		case OP_RECV:
+			if (res > 0) {
+				struct io_event &ev = push_event(fddi, POLLIN);
+				ev.rx_completed = true;
+				ev.rx_result = res;
+				ev.rx_data = has_buffer ? buf_base + (size_t)bid * buf_size : buf_base;
+			} else
+			if (res == -ENOBUFS) {
+				// Out of buffers: they come back on the next wait
+				_VBL(3) << "io_uring fd " << fddi->fd << " no rx buffer";
+			} else
+			if (res != -ECANCELED) {
+				// EOF or error: the server closes the socket, don't re-arm
+				struct io_event &ev = push_event(fddi, POLLIN);
+				ev.rx_completed = true;
+				ev.rx_result = res;
+				return;
+			}
+			break;
+
+		case OP_POLL:
+			if (res > 0)
+				push_event(fddi, res);
+			break;
+
+		case OP_POLL_OUT:
+			if ((res > 0) && (fddi->flags & FDIF_OUTPUT))
+				push_event(fddi, res & (POLLOUT | POLLERR | POLLHUP));
+			break;
+	}
+	if (!more)
+		rearm.push_back(fddi);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void URingEventManager::reap_completions()
+{
+	unsigned head = *cq_head;
+	unsigned const tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe const * const cqe = &cqes[head & *cq_mask];
+		complete(cqe->user_data, cqe->res, cqe->flags);
+	}
+	__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+
+/*************************************************************************//**
+**
+*/
+URingEventManager::event_iterator
+URingEventManager::wait_for_events(struct timespec *tout)
+{
+	prepare_wait();
+
+	if (fddescs->get_pool_usage() == 0) {
+		if (tout != 0)
+			nanosleep(tout, 0);
+		return 0;
+	}
+
+	if (submit(1, tout) < 0) {
+		if ((errno != ETIME) && (errno != EINTR) && (errno != EBUSY))
+			_LSYSERROR("io_uring_enter error");
+	}
+	reap_completions();
+	return events.size();
+}
+
+
+/*************************************************************************//**
+** Skip events of descriptors removed while the batch was being served
+*/
+URingEventManager::event_descriptor
+URingEventManager::valid_event()
+{
+	while (event_index < events.size()) {
+		struct io_event &ev = events[event_index];
+		if (ev.desc->flags & FDIF_VALID)
+			return &ev;
+		if (ev.accepted_fd >= 0)
+			close(ev.accepted_fd);
+		event_index++;
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+URingEventManager::event_descriptor
+URingEventManager::get_first_event()
+{
+	event_index = 0;
+	return valid_event();
+}
+
+
+URingEventManager::event_descriptor
+URingEventManager::get_next_event()
+{
+	event_index++;
+	return valid_event();
+}
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,180 @@
+/**
+******************************************************************************
+* @file    uring_event_mgr.hpp
+* @brief   Completion based event manager built on io_uring
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+* Uses the raw system calls, no liburing dependency. Built only when the
+* kernel headers know about multishot receive; the running kernel must be
+* 6.0 or later (checked when the ring is set up, see probe_support()),
+* IOEventManager::create() falls back to epoll otherwise.
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __URINGEVENTMGR_HPP_INCLUDED
+#define __URINGEVENTMGR_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error uring_event_mgr.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_RECV_MULTISHOT)
+#define HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "io_event_mgr.hpp"
+
+using namespace std;
+
+
+/*************************************************************************//**
+**
+** io_uring event manager. Instead of reporting readiness it keeps one
+** multishot request per descriptor in the kernel:
+**  - listening sockets: multishot accept, events carry the new socket
+**  - stream sockets: multishot recv into a ring of provided buffers, events
+**    carry the received bytes; a buffer is given back to the kernel on the
+**    next wait_for_events(), once the handler is done with it
+**  - datagram sockets and non socket descriptors (signalfd...): poll,
+**    re-armed after each event
+**  - output interest: oneshot POLLOUT poll, re-armed while still enabled
+**
+** Requests are queued and submitted in a single system call together with
+** the wait, so a busy loop costs one syscall per round.
+**
+*****************************************************************************/
+
+class URingEventManager : public IOEventManager {
+public:
+	static const unsigned DEFAULT_RX_BUFFERS = 256;
+	static const unsigned DEFAULT_RX_BUFFER_SIZE = 4096;
+
+	URingEventManager(unsigned initial_size = MIN_POLL_SIZE,
+					  unsigned rx_buffers = DEFAULT_RX_BUFFERS,
+					  unsigned rx_buffer_size = DEFAULT_RX_BUFFER_SIZE);
+	virtual ~URingEventManager();
+
+	bool is_ready() const {
+		return (ring_fd >= 0) && (buf_ring != 0);
+	}
+
+	using IOEventManager::rem_fd;
+	using IOEventManager::add_socket;
+
+	int add_fd(int fd, uint32_t events, void * udata, uint32_t flags);
+	int set_output_interest(int fd, bool enable);
+
+	event_iterator wait_for_events(struct timespec *);
+
+	event_descriptor get_first_event();
+	event_descriptor get_next_event();
+
+protected:
+	int add_socket(int fd, void *udata, uint32_t flags);
+	int rem_fd(struct fddesc_info * fddi);
+
+private:
+	// Kind of request, stored in the low bits of the user_data along with
+	// the descriptor pointer
+	enum uring_op {
+		OP_CANCEL = 0,
+		OP_ACCEPT,
+		OP_RECV,
+		OP_POLL,
+		OP_POLL_OUT
+	};
+	static const uint64_t OP_MASK = 7;
+
+	static const uint32_t FDIF_IN_ARMED  = (1L << 16);
+	static const uint32_t FDIF_OUT_ARMED = (1L << 17);
+
+	// Multishot recv
+	static const unsigned MIN_KERNEL_MAJOR = 6;
+	static const unsigned MIN_KERNEL_MINOR = 0;
+
+	static const unsigned RING_ENTRIES = 256;
+	static const unsigned BUFFER_GROUP = 0;
+
+	int setup_ring(unsigned entries);
+	int probe_support();
+	int setup_buffers(unsigned count, unsigned size);
+	struct io_uring_sqe * get_sqe();
+	int submit(unsigned wait_nr, struct timespec const * tout);
+	static unsigned input_op(struct fddesc_info const * fddi);
+	int arm_input(struct fddesc_info * fddi);
+	int arm_output(struct fddesc_info * fddi);
+	int cancel(uint64_t user_data);
+	void add_buffer(unsigned bid);
+	void prepare_wait();
+	void reap_completions();
+	void complete(uint64_t user_data, int res, uint32_t cqe_flags);
+	struct io_event & push_event(struct fddesc_info * fddi, uint32_t events);
+	event_descriptor valid_event();
+
+private:
+	int ring_fd;
+	unsigned sq_entries;
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	struct io_uring_sqe *sqes;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned sqe_tail;
+
+	void *sq_ring_ptr;
+	size_t sq_ring_size;
+	void *cq_ring_ptr;
+	size_t cq_ring_size;
+	size_t sqes_size;
+
+	struct io_uring_buf_ring *buf_ring;
+	size_t buf_ring_size;
+	uint8_t *buf_base;
+	unsigned buf_count;
+	unsigned buf_size;
+	uint16_t buf_tail;
+	vector<uint16_t> used_buffers;
+
+	vector<fddesc_info *> rearm;
+	vector<fddesc_info *> released;
+	vector<struct io_event> events;
+	size_t event_index;
+};
+
+#endif /* HAVE_IO_URING */
+
+/****************************************************************************/
+
+#endif /* __URINGEVENTMGR_HPP_INCLUDED */
+/* EOF */
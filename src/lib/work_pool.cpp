@@ -0,0 +1,270 @@
+/**
+******************************************************************************
+* @file    work_pool.cpp
+*****************************************************************************/
+
+#include <signal.h>
+#include <sched.h>
+#include "work_pool.hpp"
+
+#include "logging.hpp"
+#define LOG_SUBSYSTEM_ID "default"
+
+
+__thread WorkPool::worker * WorkPool::current = 0;
+
+
+/*************************************************************************//**
+**
+*/
+WorkPool::WorkPool(unsigned const count):
+	workers(count ? count : 1),
+	running(false),
+	next_worker(0),
+	queued(0),
+	sleepers(0)
+{
+	pthread_mutex_init(&idle_mutex, 0);
+	pthread_cond_init(&idle_cond, 0);
+	// One allocation per worker: deques written by different threads
+	// don't share cache lines
+	for (unsigned i = 0; i < workers.size(); i++) {
+		worker * const w = new worker;
+		w->pool = this;
+		w->index = i;
+		w->thread_created = false;
+		w->steals = 0;
+		pthread_mutex_init(&w->mutex, 0);
+		workers[i] = w;
+	}
+}
+
+
+/*************************************************************************//**
+**
+*/
+WorkPool::~WorkPool()
+{
+	stop();
+	for (unsigned i = 0; i < workers.size(); i++) {
+		pthread_mutex_destroy(&workers[i]->mutex);
+		delete workers[i];
+	}
+	pthread_cond_destroy(&idle_cond);
+	pthread_mutex_destroy(&idle_mutex);
+}
+
+
+/*************************************************************************//**
+**
+*/
+int WorkPool::start()
+{
+	if (__atomic_load_n(&running, __ATOMIC_SEQ_CST))
+		return -1;
+	__atomic_store_n(&running, true, __ATOMIC_SEQ_CST);
+
+	for (unsigned i = 0; i < workers.size(); i++) {
+		int res = pthread_create(&workers[i]->thread, NULL, worker_thread, workers[i]);
+		if (res != 0) {
+			_ERROR() << "cannot create worker thread " << i;
+			stop();
+			return -1;
+		}
+		workers[i]->thread_created = true;
+	}
+	_VBL(1) << "WorkPool started " << workers.size() << " workers";
+	return 0;
+}
+
+
+/*************************************************************************//**
+**
+*/
+void WorkPool::stop()
+{
+	pthread_mutex_lock(&idle_mutex);
+	__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&idle_cond);
+	pthread_mutex_unlock(&idle_mutex);
+
+	for (unsigned i = 0; i < workers.size(); i++) {
+		if (workers[i]->thread_created) {
+			pthread_join(workers[i]->thread, 0);
+			workers[i]->thread_created = false;
+			_VBL(2) << "worker " << i << " stole " << workers[i]->steals << " tasks";
+		}
+	}
+}
+
+
+/*************************************************************************//**
+** Must be called on the thread running @a origin: its completion queue is
+** created there on first use. Tasks keep being accepted from the workers
+** while stop() drains the pool.
+** The task is counted before the running flag is checked: the workers only
+** leave once stopped with no task counted, so a task accepted while
+** stop() is running is still run.
+*/
+int WorkPool::submit(WorkTask * const task, SocketServer * const origin)
+{
+	worker * w = current;
+	bool const from_worker = (w != 0) && (w->pool == this);
+	if ((task == 0) || (!from_worker && !__atomic_load_n(&running, __ATOMIC_SEQ_CST)))
+		return -1;
+
+	task->completion = 0;
+	if (origin != 0) {
+		task->completion = origin->get_completion_queue();
+		if (task->completion == 0)
+			return -1;
+	}
+
+	__atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+	if (!from_worker && !__atomic_load_n(&running, __ATOMIC_SEQ_CST)) {
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+		return -1;
+	}
+
+	if (!from_worker) {
+		unsigned const i = __atomic_fetch_add(&next_worker, 1, __ATOMIC_RELAXED);
+		w = workers[i % workers.size()];
+	}
+	push(w, task);
+	return 0;
+}
+
+
+/*************************************************************************//**
+** The task is already counted in queued. The queued count and the sleepers
+** count are sequentially consistent: either the sleeping worker sees the
+** task, or the submitter sees the sleeper and wakes it.
+*/
+void WorkPool::push(worker * const w, WorkTask * const task)
+{
+	pthread_mutex_lock(&w->mutex);
+	w->tasks.push_back(task);
+	pthread_mutex_unlock(&w->mutex);
+
+	if (__atomic_load_n(&sleepers, __ATOMIC_SEQ_CST) != 0) {
+		pthread_mutex_lock(&idle_mutex);
+		pthread_cond_signal(&idle_cond);
+		pthread_mutex_unlock(&idle_mutex);
+	}
+}
+
+
+/*************************************************************************//**
+** Newest own task
+*/
+WorkTask * WorkPool::pop(worker * const w)
+{
+	WorkTask * task = 0;
+	pthread_mutex_lock(&w->mutex);
+	if (!w->tasks.empty()) {
+		task = w->tasks.back();
+		w->tasks.pop_back();
+	}
+	pthread_mutex_unlock(&w->mutex);
+	return task;
+}
+
+
+/*************************************************************************//**
+** Oldest task of another worker, starting from the next one so that
+** thieves don't all fall on the same victim
+*/
+WorkTask * WorkPool::steal(worker * const thief)
+{
+	unsigned const n = workers.size();
+	for (unsigned k = 1; k < n; k++) {
+		worker * const victim = workers[(thief->index + k) % n];
+		if (pthread_mutex_trylock(&victim->mutex) != 0)
+			continue; // Busy: its owner or another thief is there
+		WorkTask * task = 0;
+		if (!victim->tasks.empty()) {
+			task = victim->tasks.front();
+			victim->tasks.pop_front();
+		}
+		pthread_mutex_unlock(&victim->mutex);
+		if (task != 0) {
+			thief->steals++;
+			return task;
+		}
+	}
+	return 0;
+}
+
+
+/*************************************************************************//**
+** Next task for @a w, sleeping while there is none
+** @return 0 once the pool is stopped and no task is left
+*/
+WorkTask * WorkPool::wait_task(worker * const w)
+{
+	for (;;) {
+		WorkTask * task = pop(w);
+		if (task == 0)
+			task = steal(w);
+		if (task != 0) {
+			__atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+			return task;
+		}
+
+		pthread_mutex_lock(&idle_mutex);
+		__atomic_add_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+		while ((__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0) &&
+			   __atomic_load_n(&running, __ATOMIC_SEQ_CST))
+			pthread_cond_wait(&idle_cond, &idle_mutex);
+		__atomic_sub_fetch(&sleepers, 1, __ATOMIC_SEQ_CST);
+		bool const done = !__atomic_load_n(&running, __ATOMIC_SEQ_CST) &&
+						  (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) == 0);
+		pthread_mutex_unlock(&idle_mutex);
+		if (done)
+			return 0;
+		// Tasks may be counted but briefly out of reach (trylock, or not
+		// pushed yet): just look again
+		if (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) != 0)
+			sched_yield();
+	}
+}
+
+
+/*************************************************************************//**
+** Never blocks: the server may be in stop(), waiting for this worker
+*/
+void WorkPool::complete(WorkTask * const task)
+{
+	WorkCompletionQueue * const cq = task->completion;
+	if (cq == 0) {
+		task->on_complete();
+		return;
+	}
+	cq->post_task(task);
+}
+
+
+/*************************************************************************//**
+**
+*/
+void * WorkPool::worker_thread(void * const arg)
+{
+	worker * const w = static_cast<worker *>(arg);
+
+	// Signals are handled by the main thread only
+	sigset_t sigset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, NULL);
+
+	current = w;
+	_VBL(1) << "worker " << w->index << " thread started ID:" << HEX(pthread_self(), sizeof(pthread_t)*2);
+
+	WorkTask * task;
+	while ((task = w->pool->wait_task(w)) != 0) {
+		task->run();
+		complete(task);
+	}
+
+	current = 0;
+	return 0;
+}
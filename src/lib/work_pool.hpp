@@ -0,0 +1,212 @@
+/**
+******************************************************************************
+* @file    work_pool.hpp
+* @brief   Work stealing thread pool for offloading handler work
+*
+* @author
+* @version V1.0.0
+* @date    17-Oct-2026
+*
+* @verbatim
+* @endverbatim
+*
+******************************************************************************
+* @attention
+*
+******************************************************************************
+* @note
+*
+*****************************************************************************/
+
+/*Include only once */
+#ifndef __WORK_POOL_HPP_INCLUDED
+#define __WORK_POOL_HPP_INCLUDED
+
+#ifndef __cplusplus
+#error work_pool.hpp is C++ only.
+#endif
+
+//////////////////////////////////////////////////////////////////////////////
+//                         I N C L U D E S                                  //
+//////////////////////////////////////////////////////////////////////////////
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "message_channel.hpp"
+#include "sock_server.hpp"
+
+using namespace std;
+
+
+class WorkCompletionQueue;
+
+/*************************************************************************//**
+** A unit of work: run() is called on a worker thread, then on_complete()
+** on the thread of the server the task was submitted from (see
+** WorkPool::submit()). The task belongs to the submitter, which may
+** delete it in on_complete().
+*/
+class WorkTask
+{
+	friend class WorkPool;
+
+public:
+	WorkTask():
+		completion(0)
+	{}
+
+	virtual ~WorkTask()
+	{}
+
+	virtual void run() = 0;
+	virtual void on_complete() {
+	}
+
+private:
+	WorkCompletionQueue * completion;
+};
+
+
+/*************************************************************************//**
+** Completed tasks on their way back to a server, see
+** SocketServer::get_completion_queue(). Completions that don't fit in the
+** channel go to an overflow list, drained along with it: a worker never
+** waits for the server (which may itself be waiting for the pool).
+*/
+class WorkCompletionQueue : public MessageChannel<WorkTask *>
+{
+public:
+	static const unsigned DEFAULT_CAPACITY = 1024;
+
+	WorkCompletionQueue(SocketServer * const server, unsigned const capacity = DEFAULT_CAPACITY):
+		MessageChannel<WorkTask *>(server, capacity),
+		overflowed(false)
+	{
+		pthread_mutex_init(&overflow_mutex, 0);
+	}
+
+	virtual ~WorkCompletionQueue() {
+		pthread_mutex_destroy(&overflow_mutex);
+	}
+
+	/**
+	 * Any thread
+	 */
+	void post_task(WorkTask * const task) {
+		if (post(task) == 0)
+			return;
+		pthread_mutex_lock(&overflow_mutex);
+		overflow.push_back(task);
+		__atomic_store_n(&overflowed, true, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&overflow_mutex);
+		wake();
+	}
+
+	void on_message(WorkTask * & task) {
+		task->on_complete();
+	}
+
+	int on_event(int fd, uint64_t events) {
+		MessageChannel<WorkTask *>::on_event(fd, events);
+		if (!__atomic_load_n(&overflowed, __ATOMIC_ACQUIRE))
+			return 0;
+		deque<WorkTask *> tasks;
+		pthread_mutex_lock(&overflow_mutex);
+		tasks.swap(overflow);
+		__atomic_store_n(&overflowed, false, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&overflow_mutex);
+		for (size_t i = 0; i < tasks.size(); i++)
+			tasks[i]->on_complete();
+		return 0;
+	}
+
+private:
+	pthread_mutex_t overflow_mutex;
+	deque<WorkTask *> overflow;
+	bool overflowed;
+};
+
+
+/*************************************************************************//**
+**
+** Fixed set of worker threads, each owning a deque of tasks. A worker
+** takes its own tasks newest first (the data they use is likely still in
+** its cache) and, when it has none left, steals the oldest task of
+** another worker, so that an uneven load spreads by itself. Tasks are
+** handed to the workers round robin; those submitted from a worker (a
+** task splitting its work) stay on that worker's deque.
+**
+** Idle workers sleep on a condition variable, only signalled when some
+** worker is actually sleeping.
+**
+** Completions are posted to the submitting server's WorkCompletionQueue,
+** an eventfd backed channel: on_complete() runs in its event loop, like
+** any other handler callback. Stop (or delete) the pool before the
+** servers it reports to.
+**
+*****************************************************************************/
+
+class WorkPool
+{
+public:
+	WorkPool(unsigned workers);
+	virtual ~WorkPool();
+
+	int start();
+	/**
+	 * Run the tasks already submitted (and those they submit), then
+	 * join the workers
+	 */
+	void stop();
+
+	/**
+	 * Queue @a task; on_complete() will be called on the thread running
+	 * @a origin, which must be the calling thread. Without @a origin
+	 * on_complete() is called by the worker, right after run().
+	 * @return 0 on success, -1 if the pool is not running
+	 */
+	int submit(WorkTask * task, SocketServer * origin);
+
+	unsigned get_size() const {
+		return workers.size();
+	}
+
+private:
+	struct worker {
+		WorkPool * pool;
+		unsigned index;
+		pthread_t thread;
+		bool thread_created;
+		pthread_mutex_t mutex;
+		deque<WorkTask *> tasks;
+		unsigned long steals;
+	};
+
+	static void * worker_thread(void * arg);
+	void push(worker * w, WorkTask * task);
+	WorkTask * pop(worker * w);
+	WorkTask * steal(worker * thief);
+	WorkTask * wait_task(worker * w);
+	static void complete(WorkTask * task);
+
+	WorkPool(WorkPool const &);
+	WorkPool & operator=(WorkPool const &);
+
+private:
+	vector<worker *> workers;
+	bool running;             // Atomic: read by submit() without locking
+	unsigned next_worker;
+	unsigned queued;
+	unsigned sleepers;
+	pthread_mutex_t idle_mutex;
+	pthread_cond_t idle_cond;
+
+	static __thread worker * current;
+};
+
+
+/****************************************************************************/
+
+#endif /* __WORK_POOL_HPP_INCLUDED */
+/* EOF */
@@ -32,7 +32,6 @@ static void setup_logger(const char *logname, const char *cfgname, easyloggingpp
 static void install_termination_handler(void);
 static void termination_handler(int signum);
 static void exitFunction(void);
-static void functionCyclic();
 
 //////////////////////////////////////////////////////////////////////////////
 // F U N C T I O N S                                                        //
@@ -56,21 +55,10 @@ int main(int argc, char *argv[])
 	}
 	theAppl->init();
 	
-	int ii = 0;
-	interrupted = 0;
-	while(!interrupted) {
-	    theAppl->run();
-		functionCyclic();
-	    sched_yield();
-
-		if (++ii >= 1000000L) {
-			//break;
-	    }
-	    if ((ii % 1000000L) == 0) {
-			printf(".");
-			fflush(stdout); 
-		}
-	}
+	// Blocks until termination_handler() stops the application: the
+	// periodic work runs on the application timers
+	if (!interrupted)
+		theAppl->run();
 	
 	if (theAppl != 0)
 		delete theAppl;
@@ -78,21 +66,6 @@ int main(int argc, char *argv[])
 	return EXIT_SUCCESS;
 }
 
-/////////////////////////////////////////////////////////////////////////////
-static void functionCyclic()
-{
-	static time_t prev;
-	
-	time_t now = time(0);
-	if (now != prev) {
-		prev = now;
-		struct tm tm_val;
-		gmtime_r( &now, &tm_val );
-		//printf("\ntime %ld is: %s (gmtime)", now, asctime(&tm_val) );
-		//printf("[%02d%02d%02d %02d%02d%02d]\n", tm_val.tm_mday, tm_val.tm_mon+1, tm_val.tm_year%100, tm_val.tm_hour, tm_val.tm_min, tm_val.tm_sec);
-	}
-}
-
 /////////////////////////////////////////////////////////////////////////////
 #include <sys/resource.h>
 static int splash(int argc, char *argv[])
@@ -204,6 +177,8 @@ static void termination_handler(int signum)
  	if (signum == SIGINT)  printf("Interrupted\n");
  	if (signum == SIGHUP)  printf("Hung up\n");
 	interrupted = 1;
+	if (theAppl != 0)
+		theAppl->stop();
 }
 
 /////////////////////////////////////////////////////////////////////////////